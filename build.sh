@@ -30,6 +30,26 @@ prudynt(){
 	exit 0
 }
 
+mock(){
+	echo "Build prudynt for the host against the mock IMP SDK"
+
+	cd $TOP
+	make clean
+
+	# host libraries, e.g. from ./build.sh deps with PRUDYNT_CROSS set to the host compiler
+	/usr/bin/make -j$(nproc) \
+	ARCH= CROSS_COMPILE= MOCK_IMP=1 DEBUG_STRIP=0 \
+	CFLAGS="-DPLATFORM_T31 -DBINARY_DYNAMIC -O2 -g -DALLOW_RTSP_SERVER_PORT_REUSE=1 -DNO_OPENSSL=1 \
+	-isystem ./3rdparty/install/include \
+	-isystem ./3rdparty/install/include/liveMedia \
+	-isystem ./3rdparty/install/include/groupsock \
+	-isystem ./3rdparty/install/include/UsageEnvironment \
+	-isystem ./3rdparty/install/include/BasicUsageEnvironment" \
+	LDFLAGS=" -L./3rdparty/install/lib -Wl,-rpath,$TOP/3rdparty/install/lib" \
+	-C $PWD all
+	exit 0
+}
+
 deps() {
 	rm -rf 3rdparty
 	mkdir -p 3rdparty/install
@@ -209,14 +229,19 @@ if [ $# -eq 0 ]; then
 	echo "Usage: ./build.sh deps <platform> [options]"
 	echo "       ./build.sh prudynt <platform> [options]"
 	echo "       ./build.sh full <platform> [options]"
+	echo "       ./build.sh mock"
 	echo ""
 	echo "Platforms: T20, T21, T23, T30, T31, C100, T40, T41"
 	echo "Options:   -static (optional, for static builds)"
+	echo ""
+	echo "mock builds for the host with the IMP SDK replaced by src/mock, see src/mock/Mock.hpp"
 	exit 1
 elif [[ "$1" == "deps" ]]; then
 	deps $2 $3
 elif [[ "$1" == "prudynt" ]]; then
 	prudynt $2 $3
+elif [[ "$1" == "mock" ]]; then
+	mock
 elif [[ "$1" == "full" ]]; then
 	deps $2 $3
 	prudynt $2 $3
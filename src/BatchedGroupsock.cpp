@@ -0,0 +1,193 @@
+#include "BatchedGroupsock.hpp"
+#include "Logger.hpp"
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#define MODULE "BATCHED_GROUPSOCK"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#define MAX_BATCH 64          // packets per sendmmsg() call
+#define MAX_PACKET 1500       // larger packets bypass the batch
+#define MAX_GSO_BYTES 65000   // payload limit of one segmented datagram
+#define FLUSH_TIMEOUT 2000    // us, if the marker packet does not show up
+
+static socklen_t address_size(struct sockaddr_storage const &addr)
+{
+    return addr.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+static bool same_address(struct sockaddr_storage const &a, struct sockaddr_storage const &b)
+{
+    return a.ss_family == b.ss_family && memcmp(&a, &b, address_size(a)) == 0;
+}
+
+BatchedGroupsock::BatchedGroupsock(UsageEnvironment &env, struct sockaddr_storage const &groupAddr, Port port, u_int8_t ttl)
+    : Groupsock(env, groupAddr, port, ttl), usageEnv(env), data(MAX_BATCH * MAX_PACKET),
+      flushTask(nullptr), useGso(false), sentTtl(-1),
+      sendDrops(Metrics::instance().counter("prudynt_udp_send_drops_total",
+                                            "RTP packets lost to sendmmsg() errors."))
+{
+    packets.reserve(MAX_BATCH);
+    setTtl(groupAddr.ss_family, ttl);
+
+    // probe for UDP GSO, linux 4.18 and newer
+    int segment = 0;
+    useGso = setsockopt(socketNum(), SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) == 0;
+    LOG_DEBUG("BatchedGroupsock socket:" << socketNum() << ", gso:" << useGso);
+}
+
+BatchedGroupsock::~BatchedGroupsock()
+{
+    flush();
+}
+
+Boolean BatchedGroupsock::write(struct sockaddr_storage const &addressAndPort, u_int8_t ttl,
+                                unsigned char *buffer, unsigned bufferSize)
+{
+    if (bufferSize > MAX_PACKET)
+    {
+        flush();
+        return Groupsock::write(addressAndPort, ttl, buffer, bufferSize);
+    }
+
+    if (packets.size() == MAX_BATCH)
+        flush();
+
+    // sendmmsg() bypasses OutputSocket::write, which sets the ttl
+    if (ttl != sentTtl)
+        setTtl(addressAndPort.ss_family, ttl);
+
+    memcpy(data.data() + packets.size() * MAX_PACKET, buffer, bufferSize);
+    packets.push_back({addressAndPort, bufferSize});
+
+    // the marker bit ends an access unit, RTCP packet types have it set too
+    if (bufferSize < 2 || (buffer[1] & 0x80))
+    {
+        flush();
+    }
+    else if (flushTask == nullptr)
+    {
+        flushTask = usageEnv.taskScheduler().scheduleDelayedTask(FLUSH_TIMEOUT, flush0, this);
+    }
+    return True;
+}
+
+/* Multicast datagrams default to a ttl of 1. The packets queued so far
+ * are sent with the ttl they were written with.
+ */
+void BatchedGroupsock::setTtl(int family, u_int8_t ttl)
+{
+    flush();
+
+    int value = ttl;
+    int ret = family == AF_INET6
+                  ? setsockopt(socketNum(), IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &value, sizeof(value))
+                  : setsockopt(socketNum(), IPPROTO_IP, IP_MULTICAST_TTL, &value, sizeof(value));
+    if (ret < 0)
+        LOG_WARN("BatchedGroupsock socket:" << socketNum() << ", setting ttl " << (int)ttl << " failed: " << strerror(errno));
+    sentTtl = ttl;
+}
+
+void BatchedGroupsock::flush0(void *clientData)
+{
+    BatchedGroupsock *gs = (BatchedGroupsock *)clientData;
+    gs->flushTask = nullptr;
+    gs->flush();
+}
+
+void BatchedGroupsock::flush()
+{
+    usageEnv.taskScheduler().unscheduleDelayedTask(flushTask);
+    if (packets.empty())
+        return;
+
+    size_t done = send(0, useGso);
+    if (done < packets.size())
+    {
+        // e.g. no checksum offload on the interface, stay with plain batches
+        LOG_WARN("UDP GSO failed: " << strerror(errno) << ", disabled.");
+        useGso = false;
+        send(done, false);
+    }
+    packets.clear();
+}
+
+/* Sends the packets from start on. Returns the first packet of a
+ * segmented datagram the kernel refused, or the number of packets.
+ * Other errors are treated like a failed sendto(), the packets of the
+ * failed message are lost and counted, the rest of the batch is sent.
+ */
+size_t BatchedGroupsock::send(size_t start, bool gso)
+{
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iov[MAX_BATCH];
+    char control[MAX_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+    size_t first[MAX_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+
+    unsigned count = 0;
+    for (size_t i = start, j; i < packets.size(); i = j)
+    {
+        iov[i].iov_base = data.data() + i * MAX_PACKET;
+        iov[i].iov_len = packets[i].size;
+        unsigned segment = packets[i].size;
+        unsigned total = segment;
+
+        // all segments but the last one must have the same size
+        for (j = i + 1; gso && j < packets.size(); ++j)
+        {
+            if (!same_address(packets[j].addr, packets[i].addr) || packets[j - 1].size != segment ||
+                packets[j].size > segment || total + packets[j].size > MAX_GSO_BYTES)
+                break;
+            iov[j].iov_base = data.data() + j * MAX_PACKET;
+            iov[j].iov_len = packets[j].size;
+            total += packets[j].size;
+        }
+
+        struct msghdr &hdr = msgs[count].msg_hdr;
+        hdr.msg_name = &packets[i].addr;
+        hdr.msg_namelen = address_size(packets[i].addr);
+        hdr.msg_iov = &iov[i];
+        hdr.msg_iovlen = j - i;
+        if (j - i > 1)
+        {
+            hdr.msg_control = control[count];
+            hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            struct cmsghdr *cm = CMSG_FIRSTHDR(&hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t size = segment;
+            memcpy(CMSG_DATA(cm), &size, sizeof(size));
+        }
+        first[count] = i;
+        count++;
+    }
+
+    unsigned sent = 0;
+    while (sent < count)
+    {
+        int ret = sendmmsg(socketNum(), msgs + sent, count - sent, 0);
+        if (ret > 0)
+        {
+            sent += ret;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (gso && (errno == EIO || errno == EINVAL) && msgs[sent].msg_hdr.msg_iovlen > 1)
+            return first[sent];
+        LOG_DDEBUG("sendmmsg failed: " << strerror(errno) << ", lost " << msgs[sent].msg_hdr.msg_iovlen << " packets");
+        sendDrops.add(msgs[sent].msg_hdr.msg_iovlen);
+        sent++;
+    }
+    return packets.size();
+}
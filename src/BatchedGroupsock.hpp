@@ -0,0 +1,49 @@
+#ifndef BatchedGroupsock_hpp
+#define BatchedGroupsock_hpp
+
+#include <vector>
+#include <cstdint>
+#include <sys/socket.h>
+#include "liveMedia.hh"
+#include "Groupsock.hh"
+#include "Metrics.hpp"
+
+/* Groupsock which collects the outgoing RTP packets of an access unit
+ * and sends them with a single sendmmsg() call instead of a sendto()
+ * per packet. The batch is flushed on the RTP marker bit, when it is
+ * full or after a short timeout. Where the kernel supports UDP GSO,
+ * runs of equally sized packets to the same destination are passed as
+ * one segmented datagram.
+ */
+class BatchedGroupsock : public Groupsock
+{
+public:
+    BatchedGroupsock(UsageEnvironment &env, struct sockaddr_storage const &groupAddr, Port port, u_int8_t ttl);
+    virtual ~BatchedGroupsock();
+
+    virtual Boolean write(struct sockaddr_storage const &addressAndPort, u_int8_t ttl,
+                          unsigned char *buffer, unsigned bufferSize) override;
+
+    void flush();
+
+private:
+    static void flush0(void *clientData);
+    size_t send(size_t start, bool gso);
+    void setTtl(int family, u_int8_t ttl);
+
+    struct Packet
+    {
+        struct sockaddr_storage addr;
+        unsigned size;
+    };
+
+    UsageEnvironment &usageEnv;
+    std::vector<uint8_t> data; // packet payloads, MAX_PACKET bytes each
+    std::vector<Packet> packets;
+    TaskToken flushTask;
+    bool useGso;
+    int sentTtl; // multicast ttl set on the socket, -1 before the first
+    Metrics::Counter &sendDrops;
+};
+
+#endif
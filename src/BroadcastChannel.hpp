@@ -0,0 +1,250 @@
+#ifndef BroadcastChannel_hpp
+#define BroadcastChannel_hpp
+
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+/* Single producer, multiple consumer ring. Every element is kept until
+ * all readers have passed it, each reader has its own cursor, so
+ * readers no longer compete for the same elements.
+ *
+ * Elements which start a keyframe are marked by the writer. A reader
+ * that falls behind by more than bsize elements is moved forward to the
+ * next keyframe and its lag counter is increased, the other readers are
+ * not affected. New readers start with the next keyframe as well.
+ * The capacity is rounded up to a power of two.
+ *
+ * Elements written with cache set are also collected from the last
+ * keyframe on (GOP cache). A new reader first replays that GOP, so it
+ * can start decoding right away instead of waiting for the next
+ * keyframe. Writing an uncached element invalidates the GOP.
+ *
+ * The lock only guards cursors and slot handles, payloads are never
+ * copied while it is held.
+ */
+template <class T> class BroadcastChannel {
+public:
+    struct Reader {
+        uint32_t cursor{0};               // sequence number of the next element
+        bool want_key{true};              // skip elements until a keyframe starts
+        std::atomic<uint32_t> lagged{0};  // times the reader was moved forward
+        std::atomic<uint32_t> dropped{0}; // elements the reader never saw
+        std::deque<T> replay;             // cached GOP, read before the ring
+        std::function<void(void)> onData;
+    };
+
+    BroadcastChannel(unsigned int bsize)
+        : buffer_size{capacity_for(bsize)}, slots(buffer_size) { }
+
+    std::shared_ptr<Reader> subscribe(std::function<void(void)> onData) {
+        auto reader = std::make_shared<Reader>();
+        std::unique_lock<std::mutex> lck(mtx);
+        reader->cursor = head;
+        if (gop_valid && !gop.empty()) {
+            reader->replay.assign(gop.begin(), gop.end());
+            reader->want_key = false;
+        }
+        reader->onData = std::move(onData);
+        readers.push_back(reader);
+        return reader;
+    }
+
+    void unsubscribe(const std::shared_ptr<Reader> &reader) {
+        std::unique_lock<std::mutex> lck(mtx);
+        readers.erase(std::remove(readers.begin(), readers.end(), reader), readers.end());
+        release_consumed();
+    }
+
+    size_t reader_count() {
+        std::unique_lock<std::mutex> lck(mtx);
+        return readers.size();
+    }
+
+    // a complete GOP is cached and will be replayed to new readers
+    bool has_gop() {
+        std::unique_lock<std::mutex> lck(mtx);
+        return gop_valid && !gop.empty();
+    }
+
+    // returns false if a reader lost an element it had not read yet
+    bool write(T msg, bool key, bool cache = false) {
+        bool overrun = false;
+        T old;
+        std::vector<T> old_gop;
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            if (key) {
+                old_gop.swap(gop);
+                gop_valid = cache;
+            } else if (gop_valid && !cache) {
+                old_gop.swap(gop);
+                gop_valid = false;
+            }
+            if (gop_valid)
+                gop.push_back(msg);
+
+            if (readers.empty())
+                return true;
+            Slot &slot = slots[head % buffer_size];
+            old = std::move(slot.msg);
+            slot.msg = std::move(msg);
+            slot.key = key;
+            head++;
+            for (auto &reader : readers) {
+                if (head - reader->cursor > buffer_size)
+                    overrun = true;
+            }
+            if (head - tail > buffer_size)
+                tail = head - buffer_size;
+            for (auto &reader : readers) {
+                if (reader->onData)
+                    reader->onData();
+            }
+        }
+        write_cv.notify_all();
+        return !overrun;
+    }
+
+    // replayed is set if the element comes from the cached GOP
+    bool read(Reader &reader, T *out, bool *replayed = nullptr) {
+        std::unique_lock<std::mutex> lck(mtx);
+        if (replayed)
+            *replayed = !reader.replay.empty();
+        return read_locked(reader, out);
+    }
+
+    T wait_read(Reader &reader) {
+        T val;
+        std::unique_lock<std::mutex> lck(mtx);
+        while (!read_locked(reader, &val))
+            write_cv.wait(lck);
+        return val;
+    }
+
+    // drop everything queued, readers continue with the next keyframe
+    void clear() {
+        std::unique_lock<std::mutex> lck(mtx);
+        for (auto &reader : readers) {
+            reader->cursor = head;
+            reader->want_key = true;
+            reader->replay.clear();
+        }
+        gop.clear();
+        gop_valid = false;
+        release_consumed();
+    }
+
+    /* Applies detach to the queued elements matching pred, e.g. to copy
+     * payloads out of a buffer that has to be handed back. detach runs
+     * without the lock, an element overwritten or released meanwhile is
+     * left alone.
+     */
+    template <class Pred, class Detach>
+    void detach(Pred pred, Detach detach) {
+        std::vector<std::pair<uint32_t, T>> found;
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            for (uint32_t seq = tail; seq != head; ++seq) {
+                if (pred(slots[seq % buffer_size].msg))
+                    found.emplace_back(seq, slots[seq % buffer_size].msg);
+            }
+        }
+        if (found.empty())
+            return;
+
+        for (auto &element : found)
+            detach(element.second);
+
+        std::vector<T> old;
+        old.reserve(found.size());
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            for (auto &element : found) {
+                if (element.first - tail < head - tail) {
+                    old.push_back(std::move(slots[element.first % buffer_size].msg));
+                    slots[element.first % buffer_size].msg = std::move(element.second);
+                }
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        T msg;
+        bool key{false};
+    };
+
+    // power of two, so that sequence numbers can wrap around
+    static uint32_t capacity_for(uint32_t n) {
+        uint32_t cap = 1;
+        while (cap < n)
+            cap <<= 1;
+        return cap;
+    }
+
+    bool read_locked(Reader &reader, T *out) {
+        if (!reader.replay.empty()) {
+            *out = std::move(reader.replay.front());
+            reader.replay.pop_front();
+            return true;
+        }
+        if (head - reader.cursor > buffer_size) {
+            // overrun, continue with the next keyframe still in the ring
+            reader.dropped += head - buffer_size - reader.cursor;
+            reader.cursor = head - buffer_size;
+            reader.want_key = true;
+            reader.lagged++;
+        }
+        while (reader.want_key && reader.cursor != head) {
+            if (slots[reader.cursor % buffer_size].key) {
+                reader.want_key = false;
+                break;
+            }
+            reader.cursor++;
+            reader.dropped++;
+        }
+        if (reader.cursor == head)
+            return false;
+
+        *out = slots[reader.cursor % buffer_size].msg;
+        reader.cursor++;
+        release_consumed();
+        return true;
+    }
+
+    /* drop the handles of elements every reader has passed,
+     * so they do not keep payload memory alive
+     */
+    void release_consumed() {
+        uint32_t min_cursor = head;
+        for (auto &reader : readers) {
+            if (head - reader->cursor > head - min_cursor)
+                min_cursor = reader->cursor;
+        }
+        if (head - min_cursor > buffer_size)
+            min_cursor = head - buffer_size;
+        while (static_cast<int32_t>(min_cursor - tail) > 0) {
+            slots[tail % buffer_size].msg = T();
+            tail++;
+        }
+    }
+
+    const uint32_t buffer_size;
+    std::vector<Slot> slots;
+    std::vector<std::shared_ptr<Reader>> readers;
+    uint32_t head{0}; // sequence number of the next write
+    uint32_t tail{0}; // oldest element still holding a payload
+    std::vector<T> gop;
+    bool gop_valid{false};
+    std::mutex mtx;
+    std::condition_variable write_cv;
+};
+
+#endif
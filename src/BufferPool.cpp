@@ -0,0 +1,80 @@
+#include "BufferPool.hpp"
+
+/* size, max. number of buffers
+ * 2k: audio packets and small P slices
+ * 16k: regular P slices
+ * 64k: GOP cache arena chunks and large P slices
+ * 256k: IDR slices
+ */
+static const size_t size_classes[][2] = {
+    {2048, 64},
+    {16384, 32},
+    {65536, 32},
+    {262144, 8},
+};
+
+BufferPool &BufferPool::instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::BufferPool()
+{
+    for (auto &sc : size_classes)
+        classes.emplace_back(std::make_unique<SizeClass>(sc[0], sc[1]));
+}
+
+std::shared_ptr<BufferPool::Buffer> BufferPool::acquire(size_t size)
+{
+    for (auto &sc : classes)
+    {
+        if (size > sc->size)
+            continue;
+
+        std::lock_guard lock {sc->mtx};
+        size_t n = sc->buffers.size();
+        for (size_t k = 0; k < n; ++k)
+        {
+            size_t idx = (sc->next + k) % n;
+            if (sc->buffers[idx].use_count() == 1)
+            {
+                // pairs with the release of the last foreign reference
+                std::atomic_thread_fence(std::memory_order_acquire);
+                sc->next = idx + 1;
+                sc->hits++;
+                return sc->buffers[idx];
+            }
+        }
+
+        sc->misses++;
+        if (n < sc->limit)
+        {
+            auto buf = std::make_shared<Buffer>(sc->size);
+            sc->buffers.push_back(buf);
+            return buf;
+        }
+        return std::make_shared<Buffer>(sc->size);
+    }
+
+    oversize++;
+    return std::make_shared<Buffer>(size);
+}
+
+std::vector<BufferPool::Stats> BufferPool::stats()
+{
+    std::vector<Stats> out;
+    for (auto &sc : classes)
+    {
+        std::lock_guard lock {sc->mtx};
+        uint32_t in_use = 0;
+        for (auto &buf : sc->buffers)
+        {
+            if (buf.use_count() > 1)
+                in_use++;
+        }
+        out.push_back({sc->size, sc->hits, sc->misses, (uint32_t)sc->buffers.size(), in_use});
+    }
+    out.push_back({0, 0, oversize, 0, 0});
+    return out;
+}
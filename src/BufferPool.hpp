@@ -0,0 +1,68 @@
+#ifndef BufferPool_hpp
+#define BufferPool_hpp
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/* Size classed pool for frame payloads.
+ * Buffers are handed out as shared_ptr and stay owned by the pool, a buffer
+ * is free again as soon as the pool holds the only reference. The control
+ * block is allocated once per buffer, so a hit does not touch the heap.
+ * Requests larger than the biggest class, or hitting a class which reached
+ * its limit, get a plain heap buffer and are counted as misses.
+ */
+class BufferPool
+{
+public:
+    struct Buffer
+    {
+        Buffer(size_t capacity) : data{new uint8_t[capacity]}, capacity{capacity} {}
+        ~Buffer() { delete[] data; }
+        Buffer(const Buffer &) = delete;
+        Buffer &operator=(const Buffer &) = delete;
+
+        uint8_t *data;
+        const size_t capacity;
+    };
+
+    struct Stats
+    {
+        size_t size;        // buffer size of the class, 0 for oversized requests
+        uint32_t hits;      // served from a recycled buffer
+        uint32_t misses;    // needed a new allocation
+        uint32_t buffers;   // buffers owned by the pool
+        uint32_t in_use;    // buffers currently referenced by frames
+    };
+
+    static BufferPool &instance();
+
+    // buffer with at least size bytes, recycled once the last reference is gone
+    std::shared_ptr<Buffer> acquire(size_t size);
+
+    std::vector<Stats> stats();
+
+private:
+    struct SizeClass
+    {
+        SizeClass(size_t size, size_t limit) : size{size}, limit{limit} {}
+
+        const size_t size;
+        const size_t limit;
+        std::mutex mtx;
+        std::vector<std::shared_ptr<Buffer>> buffers;
+        size_t next{0};
+        std::atomic<uint32_t> hits{0};
+        std::atomic<uint32_t> misses{0};
+    };
+
+    BufferPool();
+
+    std::vector<std::unique_ptr<SizeClass>> classes;
+    std::atomic<uint32_t> oversize{0};
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <vector>
 #include <functional>
 #include <libconfig.h++>
+#include <arpa/inet.h>
 #include "Config.hpp"
 #include "Logger.hpp"
 
@@ -93,10 +94,15 @@ std::vector<ConfigItem<bool>> CFG::getBoolItems()
         {"audio.input_agc_enabled", audio.input_agc_enabled, false, validateBool},
 #endif
 #endif
+        {"general.latency_trace", general.latency_trace, false, validateBool},
         {"image.vflip", image.vflip, false, validateBool},
         {"image.hflip", image.hflip, false, validateBool},
         {"motion.enabled", motion.enabled, false, validateBool},
         {"rtsp.auth_required", rtsp.auth_required, true, validateBool},
+        {"rtsp.batch_send", rtsp.batch_send, true, validateBool},
+        {"rtsp.multicast", rtsp.multicast, false, validateBool},
+        {"rtsp.multicast_ssm", rtsp.multicast_ssm, false, validateBool},
+        {"rtsp.shared_packetization", rtsp.shared_packetization, false, validateBool},
 #if defined(AUDIO_SUPPORT)
         {"stream0.audio_enabled", stream0.audio_enabled, true, validateBool},
 #endif
@@ -107,6 +113,8 @@ std::vector<ConfigItem<bool>> CFG::getBoolItems()
         {"stream0.osd.time_enabled", stream0.osd.time_enabled, true, validateBool},
         {"stream0.osd.uptime_enabled", stream0.osd.uptime_enabled, true, validateBool},
         {"stream0.osd.user_text_enabled", stream0.osd.user_text_enabled, true, validateBool},
+        {"stream0.osd.motion_enabled", stream0.osd.motion_enabled, false, validateBool},
+        {"stream0.osd.bitrate_graph_enabled", stream0.osd.bitrate_graph_enabled, false, validateBool},
 #if defined(AUDIO_SUPPORT)
         {"stream1.audio_enabled", stream1.audio_enabled, true, validateBool},
 #endif
@@ -117,7 +125,10 @@ std::vector<ConfigItem<bool>> CFG::getBoolItems()
         {"stream1.osd.time_enabled", stream1.osd.time_enabled, true, validateBool},
         {"stream1.osd.uptime_enabled", stream1.osd.uptime_enabled, true, validateBool},
         {"stream1.osd.user_text_enabled", stream1.osd.user_text_enabled, true, validateBool},
+        {"stream1.osd.motion_enabled", stream1.osd.motion_enabled, false, validateBool},
+        {"stream1.osd.bitrate_graph_enabled", stream1.osd.bitrate_graph_enabled, false, validateBool},
         {"stream2.enabled", stream2.enabled, true, validateBool},
+        {"stream3.enabled", stream3.enabled, false, validateBool},
         {"websocket.enabled", websocket.enabled, true, validateBool},
         {"websocket.ws_secured", websocket.ws_secured, true, validateBool},
         {"websocket.http_secured", websocket.http_secured, true, validateBool},
@@ -138,6 +149,10 @@ std::vector<ConfigItem<const char *>> CFG::getCharItems()
             return a.count(std::string(v)) == 1;
         }},
         {"motion.script_path", motion.script_path, "/usr/sbin/motion", validateCharNotEmpty},
+        {"rtsp.multicast_address", rtsp.multicast_address, "", [](const char *v) {
+            struct in_addr addr;
+            return std::strlen(v) == 0 || (inet_pton(AF_INET, v, &addr) == 1 && IN_MULTICAST(ntohl(addr.s_addr)));
+        }},
         {"rtsp.name", rtsp.name, "thingino prudynt", validateCharNotEmpty},
         {"rtsp.password", rtsp.password, "thingino", validateCharNotEmpty},
         {"rtsp.username", rtsp.username, "thingino", validateCharNotEmpty},
@@ -167,6 +182,7 @@ std::vector<ConfigItem<const char *>> CFG::getCharItems()
         {"stream1.rtsp_endpoint", stream1.rtsp_endpoint, "ch1", validateCharNotEmpty},
         {"stream1.rtsp_info", stream1.rtsp_info, "stream1", validateCharNotEmpty},
        {"stream2.jpeg_path", stream2.jpeg_path, "/tmp/snapshot.jpg", validateCharNotEmpty},
+       {"stream3.jpeg_path", stream3.jpeg_path, "/tmp/snapshot1.jpg", validateCharNotEmpty},
         {"websocket.name", websocket.name, "wss prudynt", validateCharNotEmpty},
         {"websocket.usertoken", websocket.usertoken, "", [](const char *v) {
             return std::string(v).length() < 32;
@@ -231,10 +247,15 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"motion.roi_1_y", motion.roi_1_y, IVS_AUTO_VALUE, validateIntGe0},
         {"motion.roi_count", motion.roi_count, 1, [](const int &v) { return v >= 1 && v <= 52; }},
         {"rtsp.est_bitrate", rtsp.est_bitrate, 5000, validateIntGe0},
+        {"rtsp.gop_cache_size", rtsp.gop_cache_size, 0, validateIntGe0},
+        {"rtsp.multicast_port", rtsp.multicast_port, 18888, validateInt65535},
+        {"rtsp.multicast_ttl", rtsp.multicast_ttl, 16, validateInt255},
         {"rtsp.out_buffer_size", rtsp.out_buffer_size, 500000, validateIntGe0},
+        {"rtsp.pacing_rate", rtsp.pacing_rate, 200, validateIntGe0},
         {"rtsp.port", rtsp.port, 554, validateInt65535},
         {"rtsp.send_buffer_size", rtsp.send_buffer_size, 307200, validateIntGe0},
         {"rtsp.session_reclaim", rtsp.session_reclaim, 65, validateIntGe0},
+        {"rtsp.tcp_queue_limit", rtsp.tcp_queue_limit, 131072, validateIntGe0},
         {"sensor.fps", sensor.fps, 25, validateInt120, false, "/proc/jz/sensor/max_fps"},
         {"sensor.height", sensor.height, 1080, validateIntGe0, false, "/proc/jz/sensor/height"},
         {"sensor.width", sensor.width, 1920, validateIntGe0, false, "/proc/jz/sensor/width"},
@@ -261,6 +282,10 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"stream0.osd.pos_uptime_y", stream0.osd.pos_uptime_y, OSD_AUTO_VALUE, validateInt15360},
         {"stream0.osd.pos_user_text_x", stream0.osd.pos_user_text_x, OSD_AUTO_VALUE, validateInt15360},
         {"stream0.osd.pos_user_text_y", stream0.osd.pos_user_text_y, OSD_AUTO_VALUE, validateInt15360},
+        {"stream0.osd.pos_motion_x", stream0.osd.pos_motion_x, OSD_AUTO_VALUE, validateInt15360},
+        {"stream0.osd.pos_motion_y", stream0.osd.pos_motion_y, OSD_AUTO_VALUE, validateInt15360},
+        {"stream0.osd.pos_bitrate_graph_x", stream0.osd.pos_bitrate_graph_x, OSD_AUTO_VALUE, validateInt15360},
+        {"stream0.osd.pos_bitrate_graph_y", stream0.osd.pos_bitrate_graph_y, OSD_AUTO_VALUE, validateInt15360},
         {"stream0.osd.start_delay", stream0.osd.start_delay, 1, [](const int &v) { return v >= 1 && v <= 5000; }},
         {"stream0.osd.time_rotation", stream0.osd.time_rotation, 0, validateInt360},
         {"stream0.osd.time_transparency", stream0.osd.time_transparency, 255, validateInt255},
@@ -294,6 +319,10 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"stream1.osd.pos_uptime_y", stream1.osd.pos_uptime_y, OSD_AUTO_VALUE, validateInt15360},
         {"stream1.osd.pos_user_text_x", stream1.osd.pos_user_text_x, OSD_AUTO_VALUE, validateInt15360},
         {"stream1.osd.pos_user_text_y", stream1.osd.pos_user_text_y, OSD_AUTO_VALUE, validateInt15360},
+        {"stream1.osd.pos_motion_x", stream1.osd.pos_motion_x, OSD_AUTO_VALUE, validateInt15360},
+        {"stream1.osd.pos_motion_y", stream1.osd.pos_motion_y, OSD_AUTO_VALUE, validateInt15360},
+        {"stream1.osd.pos_bitrate_graph_x", stream1.osd.pos_bitrate_graph_x, OSD_AUTO_VALUE, validateInt15360},
+        {"stream1.osd.pos_bitrate_graph_y", stream1.osd.pos_bitrate_graph_y, OSD_AUTO_VALUE, validateInt15360},
         {"stream1.osd.start_delay", stream1.osd.start_delay, 1, [](const int &v) { return v >= 1 && v <= 5000; }},
         {"stream1.osd.time_rotation", stream1.osd.time_rotation, 0, validateInt360},
         {"stream1.osd.time_transparency", stream1.osd.time_transparency, 255, validateInt255},
@@ -307,7 +336,13 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"stream2.jpeg_channel", stream2.jpeg_channel, 0, validateIntGe0},
         {"stream2.jpeg_quality", stream2.jpeg_quality, 75, [](const int &v) { return v > 0 && v <= 100; }},
         {"stream2.jpeg_idle_fps", stream2.jpeg_idle_fps, 1, [](const int &v) { return v >= 0 && v <= 30; }},
+        {"stream2.jpeg_save_interval", stream2.jpeg_save_interval, 0, [](const int &v) { return v >= -1; }},
         {"stream2.fps", stream2.fps, 25, [](const int &v) { return v > 1 && v <= 30; }},
+        {"stream3.jpeg_channel", stream3.jpeg_channel, 1, validateIntGe0},
+        {"stream3.jpeg_quality", stream3.jpeg_quality, 75, [](const int &v) { return v > 0 && v <= 100; }},
+        {"stream3.jpeg_idle_fps", stream3.jpeg_idle_fps, 1, [](const int &v) { return v >= 0 && v <= 30; }},
+        {"stream3.jpeg_save_interval", stream3.jpeg_save_interval, 0, [](const int &v) { return v >= -1; }},
+        {"stream3.fps", stream3.fps, 25, [](const int &v) { return v > 1 && v <= 30; }},
         {"websocket.loglevel", websocket.loglevel, 4096, [](const int &v) { return v > 0 && v <= 4096; }},
         {"websocket.port", websocket.port, 8089, validateInt65535},
         {"websocket.first_image_delay", websocket.first_image_delay, 100, validateInt65535},
@@ -620,15 +655,11 @@ void CFG::load()
     for (auto &item : uintItems)
         handleConfigItem(lc, item);
 
-    if (stream2.jpeg_channel == 0)
-    {
-        stream2.width = stream0.width;
-        stream2.height = stream0.height;
-    } 
-    else
+    for (_stream *jpeg : {&stream2, &stream3})
     {
-        stream2.width = stream1.width;
-        stream2.height = stream1.height;        
+        _stream *source = (jpeg->jpeg_channel == 0) ? &stream0 : &stream1;
+        jpeg->width = source->width;
+        jpeg->height = source->height;
     }
 
     Setting &root = lc.getRoot();
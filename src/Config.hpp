@@ -8,6 +8,7 @@
 #include <libconfig.h++>
 #include <sys/time.h>
 #include <any>
+#include <cstring>
 
 //~65k
 #define ENABLE_LOG_DEBUG
@@ -81,9 +82,12 @@ struct ConfigItem {
     const char *procPath = nullptr;
 };
 
+/* bps and fps are updated once per second by the grabber thread
+ * and read by OSD and WS, ts is only used by the grabber.
+ */
 struct _stream_stats {
-    uint32_t bps;
-	uint8_t fps;
+    std::atomic<uint32_t> bps{0};
+	std::atomic<uint32_t> fps{0};
 	struct timeval ts;
 };
 
@@ -97,6 +101,7 @@ struct _general {
     const char *loglevel;
     int osd_pool_size;
     int imp_polling_timeout;
+    bool latency_trace;
 };
 struct _rtsp {
     int port;
@@ -104,10 +109,20 @@ struct _rtsp {
     int out_buffer_size;
     int send_buffer_size;
     int session_reclaim;;
+    int pacing_rate;
+    int gop_cache_size;
+    int tcp_queue_limit;
+    int multicast_port;
+    int multicast_ttl;
     bool auth_required;
+    bool batch_send;
+    bool multicast;
+    bool multicast_ssm;
+    bool shared_packetization;
     const char *username;
     const char *password;
     const char *name;
+    const char *multicast_address;
 };
 struct _sensor {
     int fps;
@@ -184,12 +199,18 @@ struct _osd {
     int pos_logo_y;
     int logo_transparency;
     int logo_rotation;
+    int pos_motion_x;
+    int pos_motion_y;
+    int pos_bitrate_graph_x;
+    int pos_bitrate_graph_y;
     int start_delay;            
     bool enabled;            
     bool time_enabled;
     bool user_text_enabled;
     bool uptime_enabled;
     bool logo_enabled;         
+    bool motion_enabled;
+    bool bitrate_graph_enabled;
     const char *font_path;
     const char *time_format;
     const char *uptime_format;
@@ -226,6 +247,7 @@ struct _stream {
     int jpeg_refresh;
     int jpeg_channel;
     int jpeg_idle_fps;
+    int jpeg_save_interval;
     const char *jpeg_path;
     _osd osd;
     _stream_stats stats;
@@ -272,6 +294,7 @@ class CFG {
 	public:
 
         bool config_loaded = false;
+        std::atomic<unsigned int> changes{0}; // number of values changed by set()
         libconfig::Config lc{};
         std::string filePath{};
 
@@ -291,6 +314,7 @@ class CFG {
 		_stream stream0{};
         _stream stream1{};
 		_stream stream2{};
+		_stream stream3{};
 		_motion motion{};
         _websocket websocket{};
         _sysinfo sysinfo{};
@@ -336,6 +360,12 @@ class CFG {
         for (auto &item : *items) {
             if (item.path == name) {
                 if (item.validate(value)) {
+                    if constexpr (std::is_same_v<T, const char*>) {
+                        if (!item.value || strcmp(item.value, value) != 0)
+                            changes++;
+                    } else if (item.value != value) {
+                        changes++;
+                    }
                     item.value = value;
                     item.noSave = noSave;
                     return true;
@@ -0,0 +1,251 @@
+#include "FontCache.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#if defined(__mips_msa)
+#include <msa.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Glyph alpha masks are combined row by row with a saturating max, which
+ * also builds the stroke masks. MSA and NEON do 16 pixels at a time.
+ */
+void Font::maxRow(uint8_t *dst, const uint8_t *src, int n)
+{
+    int i = 0;
+#if defined(__mips_msa)
+    for (; i + 16 <= n; i += 16)
+    {
+        v16u8 a = (v16u8)__msa_ld_b((void *)(dst + i), 0);
+        v16u8 b = (v16u8)__msa_ld_b((void *)(src + i), 0);
+        __msa_st_b((v16i8)__msa_max_u_b(a, b), (void *)(dst + i), 0);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16)
+    {
+        vst1q_u8(dst + i, vmaxq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        if (src[i] > dst[i])
+            dst[i] = src[i];
+    }
+}
+
+Font::~Font()
+{
+    if (sft.font)
+        sft_freefont(sft.font);
+}
+
+int Font::load()
+{
+    LOG_DEBUG("Font::load(" << style.path << ", " << style.xScale << "x" << style.yScale
+                            << ", stroke " << style.stroke << ")");
+
+    std::ifstream fontFile(style.path, std::ios::binary | std::ios::ate);
+    if (!fontFile.is_open())
+    {
+        LOG_DEBUG("Unable to open font file.");
+        return -1;
+    }
+
+    size_t fileSize = fontFile.tellg();
+    fontFile.seekg(0, std::ios::beg);
+    fontData.resize(fileSize);
+    fontFile.read(reinterpret_cast<char *>(fontData.data()), fileSize);
+    fontFile.close();
+
+    sft.flags = SFT_DOWNWARD_Y;
+    sft.xScale = style.xScale;
+    sft.yScale = style.yScale;
+    sft.yOffset = style.yOffset;
+    sft.font = sft_loadmem(fontData.data(), fontData.size());
+    if (!sft.font)
+    {
+        LOG_DEBUG("Unable to load font data.");
+        return -1;
+    }
+
+    uint8_t text[3] = {(uint8_t)(style.color >> 0), (uint8_t)(style.color >> 8), (uint8_t)(style.color >> 16)};
+    uint8_t stroke[3] = {(uint8_t)(style.strokeColor >> 0), (uint8_t)(style.strokeColor >> 8),
+                         (uint8_t)(style.strokeColor >> 16)};
+    for (int a = 0; a < 256; ++a)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            // without a stroke the glyph alpha is the pixel alpha, else
+            // the text is blended onto the opaque stroke
+            textColor[a][c] = style.stroke ? (stroke[c] * (255 - a) + text[c] * a + 127) / 255 : text[c];
+        }
+    }
+
+    renderGlyph("01234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!§$%&/()=?,.-_:;#'+*~}{} ");
+    atlas.shrink_to_fit();
+
+    for (char c = '0'; c <= '9'; ++c)
+    {
+        auto it = glyphs.find(c);
+        if (it != glyphs.end())
+            digitAdvance = std::max(digitAdvance, it->second.advance);
+    }
+
+    return 0;
+}
+
+void Font::renderGlyph(const char *characters)
+{
+    int stroke = style.stroke;
+
+    while (*characters)
+    {
+
+        SFT_LMetrics lmetrics;
+        SFT_GMetrics gmetrics;
+        SFT_Glyph glyph;
+        SFT_Image imageBuffer;
+
+        if (sft_lmetrics(&sft, &lmetrics) == 0 && sft_lookup(&sft, *characters, &glyph) == 0)
+        {
+            if (sft_gmetrics(&sft, glyph, &gmetrics) == 0)
+            {
+                imageBuffer.width = gmetrics.minWidth;
+                imageBuffer.height = gmetrics.minHeight;
+                imageBuffer.pixels = (uint8_t *)malloc(imageBuffer.width * imageBuffer.height);
+
+                if (sft_render(&sft, glyph, imageBuffer) == 0)
+                {
+                    Glyph g;
+                    g.width = imageBuffer.width;
+                    g.height = imageBuffer.height;
+                    g.cellWidth = g.width + stroke * 2;
+                    g.cellHeight = g.height + stroke * 2;
+                    g.advance = gmetrics.advanceWidth;
+                    g.xmin = gmetrics.leftSideBearing;
+                    g.ymin = gmetrics.yOffset;
+                    g.glyph = glyph;
+
+                    size_t cellSize = g.cellWidth * g.cellHeight;
+                    g.text = atlas.size();
+                    g.stroke = stroke ? g.text + cellSize : g.text;
+                    atlas.resize(atlas.size() + (stroke ? cellSize * 2 : cellSize), 0);
+
+                    // the glyph, with a border for the stroke
+                    uint8_t *text = &atlas[g.text];
+                    for (int y = 0; y < g.height; ++y)
+                    {
+                        memcpy(text + (y + stroke) * g.cellWidth + stroke,
+                               (uint8_t *)imageBuffer.pixels + y * g.width, g.width);
+                    }
+
+                    // the stroke, the glyph dilated by a disk of the stroke width
+                    if (stroke)
+                    {
+                        uint8_t *outline = &atlas[g.stroke];
+                        for (int j = -stroke; j <= stroke; ++j)
+                        {
+                            for (int i = -stroke; i <= stroke; ++i)
+                            {
+                                if (i * i + j * j > stroke * stroke)
+                                    continue;
+                                for (int y = 0; y < g.height; ++y)
+                                {
+                                    maxRow(outline + (y + stroke + j) * g.cellWidth + stroke + i,
+                                           (uint8_t *)imageBuffer.pixels + y * g.width, g.width);
+                                }
+                            }
+                        }
+                        // the stroke is opaque wherever it covers the glyph
+                        for (size_t i = 0; i < cellSize; ++i)
+                        {
+                            if (outline[i])
+                                outline[i] = 255;
+                        }
+                    }
+
+                    glyphs[*characters] = g;
+                }
+                free(imageBuffer.pixels);
+            }
+        }
+        ++characters;
+    }
+}
+
+bool Font::findText(const std::string &text, int angle, uint8_t *&image, uint16_t &width, uint16_t &height)
+{
+    std::lock_guard lock{textMutex};
+    for (auto it = texts.begin(); it != texts.end(); ++it)
+    {
+        if (it->angle == angle && it->text == text)
+        {
+            if (!image || it->width != width || it->height != height)
+            {
+                free(image);
+                image = (uint8_t *)malloc(it->image.size());
+                width = it->width;
+                height = it->height;
+            }
+            memcpy(image, it->image.data(), it->image.size());
+            std::rotate(texts.begin(), it, it + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Font::storeText(const std::string &text, int angle, uint16_t width, uint16_t height, const uint8_t *image)
+{
+    std::lock_guard lock{textMutex};
+    for (auto &t : texts)
+    {
+        if (t.angle == angle && t.text == text)
+            return;
+    }
+
+    // reuse the least recently used entry and its buffer
+    if (texts.size() < FONT_CACHE_TEXTS)
+        texts.emplace_back();
+    std::rotate(texts.begin(), texts.end() - 1, texts.end());
+
+    Text &t = texts.front();
+    t.text = text;
+    t.angle = angle;
+    t.width = width;
+    t.height = height;
+    t.image.assign(image, image + width * height * 4);
+}
+
+FontCache &FontCache::instance()
+{
+    static FontCache cache;
+    return cache;
+}
+
+std::shared_ptr<Font> FontCache::get(const FontStyle &style)
+{
+    std::lock_guard lock{mutex};
+
+    fonts.erase(std::remove_if(fonts.begin(), fonts.end(), [](const std::weak_ptr<Font> &f)
+                               { return f.expired(); }),
+                fonts.end());
+
+    for (auto &f : fonts)
+    {
+        auto font = f.lock();
+        if (font && font->style == style)
+            return font;
+    }
+
+    auto font = std::make_shared<Font>(style);
+    if (font->load() != 0)
+        return nullptr;
+
+    fonts.push_back(font);
+    return font;
+}
@@ -0,0 +1,116 @@
+#ifndef FontCache_hpp
+#define FontCache_hpp
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include "schrift.h"
+
+// rendered texts kept per font
+#define FONT_CACHE_TEXTS 8
+
+/* A glyph in the atlas, as two alpha masks of the same cell size: the
+ * glyph itself and the glyph dilated by the stroke width. The cell is the
+ * glyph bitmap with a border of the stroke width around it.
+ */
+struct Glyph {
+    int width;
+    int height;
+    int cellWidth;
+    int cellHeight;
+    size_t text;   // atlas offset of the glyph mask
+    size_t stroke; // atlas offset of the stroke mask
+    int advance;
+    int xmin;
+    int ymin;
+    SFT_Glyph glyph;
+};
+
+struct FontStyle
+{
+    std::string path;
+    int xScale;
+    int yScale;
+    int yOffset;
+    int stroke;
+    unsigned int color;
+    unsigned int strokeColor;
+
+    bool operator==(const FontStyle &other) const = default;
+};
+
+/* A font rendered into a glyph atlas for one style. It doesn't change
+ * once loaded and is shared by the OSDs of all streams using the style,
+ * along with the bitmaps of the last texts they rendered, so a text shown
+ * on both streams is drawn once.
+ */
+class Font
+{
+public:
+    Font(const FontStyle &style) : style{style} {}
+    ~Font();
+    Font(const Font &) = delete;
+    Font &operator=(const Font &) = delete;
+
+    const FontStyle style;
+    SFT sft{};
+    std::unordered_map<char, Glyph> glyphs;
+    std::vector<uint8_t> atlas;
+    int digitAdvance{0}; // digits are drawn in cells of the widest digit
+
+    // color of a text pixel by its glyph alpha, blended from stroke to text color
+    uint8_t textColor[256][3];
+
+    /* Copies the bitmap of text rendered before into the malloc'ed image of
+     * width x height, which is reallocated if the size differs. False if
+     * there is none.
+     */
+    bool findText(const std::string &text, int angle, uint8_t *&image, uint16_t &width, uint16_t &height);
+    void storeText(const std::string &text, int angle, uint16_t width, uint16_t height, const uint8_t *image);
+
+    // dst = max(dst, src), MSA or NEON where available
+    static void maxRow(uint8_t *dst, const uint8_t *src, int n);
+
+private:
+    friend class FontCache;
+
+    int load();
+    void renderGlyph(const char *characters);
+
+    struct Text
+    {
+        std::string text;
+        int angle;
+        uint16_t width;
+        uint16_t height;
+        std::vector<uint8_t> image;
+    };
+
+    std::vector<uint8_t> fontData; // sft.font points into it
+    std::mutex textMutex;
+    std::vector<Text> texts; // most recently used first
+};
+
+/* Process wide cache of fonts by style. Fonts are loaded on first use and
+ * freed with the last OSD holding them.
+ */
+class FontCache
+{
+public:
+    static FontCache &instance();
+
+    // the font for style, nullptr if it can't be loaded
+    std::shared_ptr<Font> get(const FontStyle &style);
+
+private:
+    FontCache() = default;
+
+    std::mutex mutex;
+    std::vector<std::weak_ptr<Font>> fonts;
+};
+
+#endif
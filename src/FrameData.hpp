@@ -0,0 +1,118 @@
+#ifndef FrameData_hpp
+#define FrameData_hpp
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "BufferPool.hpp"
+
+/* Read-only view on a frame payload.
+ * The payload is kept alive by a shared owner, which is either a pooled copy,
+ * an arena chunk or a pinned encoder stream that gets released when the
+ * last view is gone.
+ * Copying a FrameData copies the reference, never the payload.
+ */
+class FrameData
+{
+public:
+    FrameData() = default;
+
+    FrameData(std::shared_ptr<const void> owner, const uint8_t *ptr, size_t len)
+        : owner{std::move(owner)}, ptr{ptr}, len{len} {}
+
+    // pooled copy of [ptr, ptr + len)
+    static FrameData copy(const uint8_t *ptr, size_t len)
+    {
+        return copy(ptr, len, nullptr, 0);
+    }
+
+    // pooled copy of two pieces back to back, e.g. a pack wrapping around
+    static FrameData copy(const uint8_t *ptr1, size_t len1, const uint8_t *ptr2, size_t len2)
+    {
+        if (len1 + len2 == 0)
+            return FrameData();
+        auto buf = BufferPool::instance().acquire(len1 + len2);
+        memcpy(buf->data, ptr1, len1);
+        if (len2)
+            memcpy(buf->data + len1, ptr2, len2);
+        return FrameData(buf, buf->data, len1 + len2);
+    }
+
+    // deep copy which no longer holds on to the original owner
+    FrameData clone() const { return copy(ptr, len); }
+
+    // the shared owner, to tell which views keep the same buffer alive
+    const void *owner_ptr() const { return owner.get(); }
+
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+
+    const uint8_t &operator[](size_t i) const { return ptr[i]; }
+    const uint8_t *begin() const { return ptr; }
+    const uint8_t *end() const { return ptr + len; }
+
+private:
+    std::shared_ptr<const void> owner;
+    const uint8_t *ptr{nullptr};
+    size_t len{0};
+};
+
+/* Chunked arena holding the payloads of one GOP back to back.
+ * Views into a chunk keep it alive, so reset() can start the next GOP
+ * while the previous one is still being replayed. Once more than limit
+ * bytes are stored the arena stays invalid until the next reset().
+ */
+class FrameArena
+{
+public:
+    FrameArena(size_t limit, size_t chunk_size = 65536)
+        : limit{limit}, chunk_size{chunk_size} {}
+
+    void reset()
+    {
+        chunk.reset();
+        used = 0;
+        capacity = 0;
+        total = 0;
+        is_valid = limit > 0;
+    }
+
+    bool valid() const { return is_valid; }
+
+    // copy into the arena, returns an empty view once the limit is exceeded
+    FrameData store(const uint8_t *src, size_t n)
+    {
+        if (!is_valid || total + n > limit)
+        {
+            is_valid = false;
+            chunk.reset();
+            return FrameData();
+        }
+        if (!chunk || used + n > capacity)
+        {
+            chunk = BufferPool::instance().acquire(std::max(n, chunk_size));
+            capacity = chunk->capacity;
+            used = 0;
+        }
+        uint8_t *dst = chunk->data + used;
+        memcpy(dst, src, n);
+        used += n;
+        total += n;
+        return FrameData(chunk, dst, n);
+    }
+
+private:
+    const size_t limit;
+    const size_t chunk_size;
+    std::shared_ptr<BufferPool::Buffer> chunk;
+    size_t used{0};
+    size_t capacity{0};
+    size_t total{0};
+    bool is_valid{false};
+};
+
+#endif
@@ -1,8 +1,13 @@
 #include "IMPDeviceSource.hpp"
+#include "Tracer.hpp"
 #include <iostream>
 #include "GroupsockHelper.hh"
-#include <thread>
 #include <chrono>
+#include <algorithm>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 // explicit instantiation
 template class IMPDeviceSource<H264NALUnit, video_stream>;
@@ -17,27 +22,62 @@ IMPDeviceSource<FrameType, Stream> *IMPDeviceSource<FrameType, Stream>::createNe
 template<typename FrameType, typename Stream>
 IMPDeviceSource<FrameType, Stream>::IMPDeviceSource(UsageEnvironment &env, int encChn, std::shared_ptr<Stream> stream, const char *name)
     : FramedSource(env), encChn(encChn), stream{stream}, name{name}, eventTriggerId(0), 
-      firstFrame(true), base_timestamp(0), timestamp_initialized(false), droppedFrames(0)
+      firstFrame(true), base_timestamp(0), timestamp_initialized(false), droppedFrames(0),
+      hasPending(false), pendingCopied(false), pendingReplayed(false), pacingTask(nullptr), pacingRate(0), pacingBurst(0), pacingTokens(0), pacingLast(0),
+      laggedReported(0), isH265(false), tcpSocket(-1), tcpQueueLimit(0), dropGop(false), congestionDrops(0),
+      traceAu(0), traceSinkReady(0)
 {
-    std::lock_guard lock_stream {mutex_main};
-    std::lock_guard lock_callback {stream->onDataCallbackLock};
-    stream->onDataCallback = [this]()
-    { this->on_data_available(); };
-    stream->hasDataCallback = true;
+    if constexpr (std::is_same_v<FrameType, H264NALUnit>)
+    {
+        isH265 = strcmp(stream->stream->format, "H265") == 0;
+
+        // the socket send buffer absorbs bursts up to its size
+        pacingBurst = cfg->rtsp.send_buffer_size;
+        pacingTokens = pacingBurst;
+    }
 
     eventTriggerId = envir().taskScheduler().createEventTrigger(deliverFrame0);
-    stream->should_grab_frames.notify_one();
+
+    std::lock_guard lock_stream {stream->mtx};
+    if constexpr (std::is_same_v<FrameType, H264NALUnit>)
+    {
+        // every source reads the stream with its own cursor
+        reader = stream->msgChannel->subscribe([this]()
+        { this->on_data_available(); });
+        sessionStats = std::make_shared<session_stats>(stream->next_session_id++);
+        stream->sessions.push_back(sessionStats);
+    }
+    else
+    {
+        std::lock_guard lock_callback {stream->onDataCallbackLock};
+        stream->onDataCallback = [this]()
+        { this->on_data_available(); };
+    }
+    stream->hasDataCallback = true;
+
+    stream->should_grab_frames.notify_all();
     LOG_DEBUG("IMPDeviceSource " << name << " constructed, encoder channel:" << encChn);
 }
 
 template<typename FrameType, typename Stream>
 void IMPDeviceSource<FrameType, Stream>::deinit()
 {
-    std::lock_guard lock_stream {mutex_main};
-    std::lock_guard lock_callback {stream->onDataCallbackLock};
+    std::lock_guard lock_stream {stream->mtx};
+    if constexpr (std::is_same_v<FrameType, H264NALUnit>)
+    {
+        stream->msgChannel->unsubscribe(reader);
+        stream->hasDataCallback = stream->msgChannel->reader_count() > 0;
+        auto &sessions = stream->sessions;
+        sessions.erase(std::remove(sessions.begin(), sessions.end(), sessionStats), sessions.end());
+    }
+    else
+    {
+        std::lock_guard lock_callback {stream->onDataCallbackLock};
+        stream->hasDataCallback = false;
+        stream->onDataCallback = nullptr;
+    }
+    envir().taskScheduler().unscheduleDelayedTask(pacingTask);
     envir().taskScheduler().deleteEventTrigger(eventTriggerId);
-    stream->hasDataCallback = false;
-    stream->onDataCallback = nullptr;
     LOG_DEBUG("IMPDeviceSource " << name << " destructed, encoder channel:" << encChn);
 }
 
@@ -50,6 +90,14 @@ IMPDeviceSource<FrameType, Stream>::~IMPDeviceSource()
 template<typename FrameType, typename Stream>
 void IMPDeviceSource<FrameType, Stream>::doGetNextFrame()
 {
+    /* the sink asks for the next NAL unit after it has sent the packet
+     * with the previous one, see the SENT stamp in deliverFrame()
+     */
+    if constexpr (std::is_same_v<FrameType, H264NALUnit>)
+    {
+        if (Tracer::instance().enabled())
+            traceSinkReady = Tracer::now();
+    }
     deliverFrame();
 }
 
@@ -59,35 +107,208 @@ void IMPDeviceSource<FrameType, Stream>::deliverFrame0(void *clientData)
     ((IMPDeviceSource<FrameType, Stream> *)clientData)->deliverFrame();
 }
 
+template <typename FrameType, typename Stream>
+void IMPDeviceSource<FrameType, Stream>::pacingDone0(void *clientData)
+{
+    auto *source = (IMPDeviceSource<FrameType, Stream> *)clientData;
+    source->pacingTask = nullptr;
+    source->deliverFrame();
+}
+
+/* Token bucket, refilled with pacingRate bytes per microsecond up to
+ * pacingBurst. A frame may be sent as long as the bucket is not empty,
+ * which lets the bucket go negative on large frames and delays the
+ * following ones. Instead of sleeping, the delivery is rescheduled on
+ * the event loop, so other sessions keep running meanwhile.
+ */
+template <typename FrameType, typename Stream>
+bool IMPDeviceSource<FrameType, Stream>::pace(size_t frameSize)
+{
+    /* stream bitrate is kbps, pacing_rate is percent of it. The rate is
+     * taken per frame to follow bitrate changes of the running encoder.
+     */
+    if constexpr (std::is_same_v<FrameType, H264NALUnit>)
+    {
+        int bitrate = stream->bitrate.load(std::memory_order_relaxed);
+        pacingRate = cfg->rtsp.pacing_rate > 0 && bitrate > 0
+                         ? bitrate * 1000.0 / 8 * cfg->rtsp.pacing_rate / 100 / 1000000
+                         : 0;
+    }
+    if (pacingRate <= 0)
+        return true;
+
+    int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (pacingLast)
+        pacingTokens = std::min(pacingBurst, pacingTokens + (now - pacingLast) * pacingRate);
+    pacingLast = now;
+
+    if (pacingTokens < 0)
+    {
+        if (pacingTask == nullptr)
+        {
+            int64_t delay = (int64_t)(-pacingTokens / pacingRate) + 1;
+            pacingTask = envir().taskScheduler().scheduleDelayedTask(delay, pacingDone0, this);
+        }
+        return false;
+    }
+
+    pacingTokens -= frameSize;
+    return true;
+}
+
+template <typename FrameType, typename Stream>
+void IMPDeviceSource<FrameType, Stream>::setTcpSocket(int socketNum)
+{
+    tcpSocket = socketNum;
+    tcpQueueLimit = cfg->rtsp.tcp_queue_limit;
+    if (sessionStats)
+        sessionStats->tcp = true;
+
+    // interleaved packets are small, do not hold them back for coalescing
+    int one = 1;
+    setsockopt(tcpSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    increaseSendBufferTo(envir(), tcpSocket, cfg->rtsp.send_buffer_size);
+
+    LOG_DEBUG("IMPDeviceSource " << name << " uses RTP over TCP, socket:" << tcpSocket <<
+              ", queue limit:" << tcpQueueLimit);
+}
+
+/* Congestion handling for RTP over TCP. The unsent bytes of the RTSP
+ * connection tell how far the client is behind. Above half the limit
+ * non-reference slices are dropped, they are not needed to decode the
+ * rest of the GOP. Above the limit everything is dropped, until the
+ * queue has drained below half the limit and a keyframe starts.
+ * This keeps the latency bounded on a slow uplink.
+ */
+template <typename FrameType, typename Stream>
+bool IMPDeviceSource<FrameType, Stream>::congested(const FrameType &frame)
+{
+    if (tcpSocket < 0 || tcpQueueLimit <= 0 || frame.data.empty())
+        return false;
+
+    int queued = 0;
+    if (ioctl(tcpSocket, TIOCOUTQ, &queued) != 0)
+        return false;
+
+    uint8_t hdr = frame.data[0];
+    int type = isH265 ? (hdr & 0x7E) >> 1 : hdr & 0x1F;
+    bool key = isH265 ? (type == 32 || type == 19 || type == 20) : (type == 7 || type == 5);
+    // H264 slice with nal_ref_idc 0, H265 sub-layer non-reference picture
+    bool disposable = isH265 ? (type < 16 && type % 2 == 0) : (type == 1 && (hdr & 0x60) == 0);
+
+    if (dropGop)
+    {
+        if (!key || queued > tcpQueueLimit / 2)
+        {
+            congestionDrops++;
+            return true;
+        }
+        LOG_INFO("IMPDeviceSource " << name << " send queue drained, resuming at keyframe. " <<
+                 "dropped:" << congestionDrops);
+        dropGop = false;
+        congestionDrops = 0;
+        return false;
+    }
+
+    if (queued > tcpQueueLimit)
+    {
+        LOG_WARN("IMPDeviceSource " << name << " send queue " << queued << " bytes over limit " <<
+                 tcpQueueLimit << ", dropping until the next keyframe.");
+        dropGop = true;
+        congestionDrops++;
+        return true;
+    }
+
+    if (queued > tcpQueueLimit / 2 && disposable)
+    {
+        congestionDrops++;
+        return true;
+    }
+
+    return false;
+}
+
 template <typename FrameType, typename Stream>
 void IMPDeviceSource<FrameType, Stream>::deliverFrame()
 {
     if (!isCurrentlyAwaitingData())
         return;
 
-    FrameType nal;
-    if (stream->msgChannel->read(&nal))
+    if (!hasPending)
     {
-        // Add frame pacing delays to prevent overwhelming the network stack
-        // This is critical for proper stream delivery, especially for I-frames
-        bool isIFrame = false;
-        if constexpr (std::is_same_v<FrameType, H264NALUnit>) {
-            // Check if this is an I-frame (typically much larger)
-            if (nal.data.size() > 0 && nal.data.size() > 10000) {
-                // I-frames are typically much larger, use a longer delay
-                isIFrame = true;
-                std::this_thread::sleep_for(std::chrono::milliseconds(3));
-            } else {
-                // Regular inter frames get a smaller delay
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if constexpr (std::is_same_v<FrameType, H264NALUnit>)
+        {
+            while ((hasPending = stream->msgChannel->read(*reader, &pending, &pendingReplayed)) && congested(pending))
+            {
+                sessionStats->congestion_drops++;
+                stream->stats.congestion_drops.add();
             }
+
+            /* an access unit is sent when the sink asks for the NAL unit
+             * following its last one, which we know only at the next one
+             */
+            if (hasPending && pending.imp_ts != traceAu && Tracer::instance().enabled())
+            {
+                Tracer::instance().stamp(Tracer::SENT, encChn, sessionStats->id, traceAu, traceSinkReady);
+                Tracer::instance().stamp(Tracer::DELIVER, encChn, sessionStats->id, pending.imp_ts);
+                traceAu = pending.imp_ts;
+            }
+
+            uint32_t lagDrops = reader->dropped - sessionStats->lag_drops;
+            if (lagDrops)
+            {
+                sessionStats->lag_drops += lagDrops;
+                stream->stats.lag_drops.add(lagDrops);
+            }
+
+            if (reader->lagged != laggedReported)
+            {
+                laggedReported = reader->lagged;
+                sessionStats->lagged = laggedReported;
+                LOG_WARN("IMPDeviceSource " << name << " fell behind, skipped to the next keyframe. " <<
+                         "lagged:" << laggedReported << ", dropped:" << reader->dropped);
+            }
+        }
+        else
+        {
+            hasPending = stream->msgChannel->read(&pending);
+        }
+    }
+
+    if (hasPending)
+    {
+        // the cached GOP is replayed at burst rate for a quick start
+        if (!pendingReplayed && !pace(pending.data.size()))
+        {
+            /* don't keep an encoder stream pinned while waiting, the
+             * streams following it go back to the encoder behind it
+             */
+            if constexpr (std::is_same_v<FrameType, H264NALUnit>)
+            {
+                if (!pendingCopied)
+                {
+                    pending.data = pending.data.clone();
+                    pendingCopied = true;
+                }
+            }
+            return;
         }
+        pendingCopied = false;
+
+        FrameType nal = std::move(pending);
+        hasPending = false;
 
         // Check if the frame is too large for the buffer
         if (nal.data.size() > fMaxSize)
         {
             // Track dropped frames for diagnostics
             droppedFrames++;
+            if constexpr (std::is_same_v<FrameType, H264NALUnit>)
+            {
+                sessionStats->oversize_drops++;
+                stream->stats.oversize_drops.add();
+            }
             
             // If we drop too many frames in succession, log a warning
             if (droppedFrames % 10 == 1) {
@@ -157,10 +378,21 @@ void IMPDeviceSource<FrameType, Stream>::deliverFrame()
             }
         }
         
-        memcpy(fTo, &nal.data[0], fFrameSize);
+        memcpy(fTo, nal.data.data(), fFrameSize);
 
         if (fFrameSize > 0)
         {
+            // imp_ts is 0 if the encoder gave no timestamp
+            if constexpr (std::is_same_v<FrameType, H264NALUnit>)
+            {
+                sessionStats->frames.fetch_add(1, std::memory_order_relaxed);
+                if (nal.imp_ts > 0)
+                    stream->stats.send_latency.observe(metrics_elapsed_us(nal.imp_ts));
+            }
+            else if (nal.imp_ts > 0)
+            {
+                stream->send_latency.observe(metrics_elapsed_us(nal.imp_ts));
+            }
             FramedSource::afterGetting(this);
         }
     }
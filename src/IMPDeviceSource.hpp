@@ -24,11 +24,17 @@ public:
     IMPDeviceSource(UsageEnvironment &env, int encChn, std::shared_ptr<Stream> stream, const char *name);
     virtual ~IMPDeviceSource();
 
+    // the session is interleaved into this RTSP connection (RTP over TCP)
+    void setTcpSocket(int socketNum);
+
 private:
     
     virtual void doGetNextFrame() override;
     static void deliverFrame0(void *clientData);
+    static void pacingDone0(void *clientData);
     void deliverFrame();
+    bool pace(size_t frameSize);
+    bool congested(const FrameType &frame);
     void deinit();
     int encChn;
     std::shared_ptr<Stream> stream;
@@ -40,6 +46,30 @@ private:
     bool timestamp_initialized;
     // For tracking dropped frames
     unsigned int droppedFrames;
+    // Token bucket pacing, see pace()
+    FrameType pending;
+    bool hasPending;
+    bool pendingCopied;   // pending no longer points into encoder memory
+    bool pendingReplayed; // pending is part of the cached GOP
+    TaskToken pacingTask;
+    double pacingRate;  // bytes per microsecond, 0 disables pacing
+    double pacingBurst; // bucket depth in bytes
+    double pacingTokens;
+    int64_t pacingLast;
+    // Own cursor into the video broadcast channel
+    std::shared_ptr<typename BroadcastChannel<FrameType>::Reader> reader;
+    uint32_t laggedReported;
+    // Send queue watch for RTP over TCP, see congested()
+    bool isH265;
+    int tcpSocket;       // -1 for UDP
+    int tcpQueueLimit;   // bytes, 0 disables dropping
+    bool dropGop;
+    unsigned int congestionDrops;
+    // Counters for the stats endpoints, video only
+    std::shared_ptr<session_stats> sessionStats;
+    // Latency trace, see Tracer. Access unit in delivery and when the sink last asked for data
+    int64_t traceAu;
+    int64_t traceSinkReady;
 };
 
 #endif
@@ -312,11 +312,20 @@ int IMPEncoder::init()
 
     initProfile();
 
+    bitrate = stream->bitrate;
+    gop = stream->gop;
+    fps = stream->fps;
+    sourceFps = stream->fps;
+
 #if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
     if(cfg->stream2.enabled && cfg->stream2.jpeg_channel == encChn && stream->allow_shared) {
         ret = IMP_Encoder_SetbufshareChn(2, encChn);
         LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_Encoder_SetbufshareChn(2, " << encChn << ")");
     }
+    if(cfg->stream3.enabled && cfg->stream3.jpeg_channel == encChn && stream->allow_shared) {
+        ret = IMP_Encoder_SetbufshareChn(3, encChn);
+        LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_Encoder_SetbufshareChn(3, " << encChn << ")");
+    }
 #endif
 
     ret = IMP_Encoder_CreateChn(encChn, &chnAttr);
@@ -374,6 +383,78 @@ int IMPEncoder::init()
     return ret;
 }
 
+/* Applies changes of bitrate, gop and fps to the running channel.
+ * Called from the thread reading the channel, the stream keeps going.
+ */
+int IMPEncoder::reconfigure()
+{
+    int ret = 0;
+
+    if (strcmp(stream->format, "JPEG") == 0)
+        return 0;
+
+    if (stream->bitrate != bitrate)
+    {
+#if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
+        ret = IMP_Encoder_SetChnBitRate(encChn, stream->bitrate, stream->bitrate);
+        LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnBitRate(" << encChn << ", " << stream->bitrate << ")");
+#elif defined(PLATFORM_T10) || defined(PLATFORM_T20) || defined(PLATFORM_T21) || defined(PLATFORM_T23) || defined(PLATFORM_T30)
+        IMPEncoderAttrRcMode rcMode;
+        ret = IMP_Encoder_GetChnAttrRcMode(encChn, &rcMode);
+        if (ret == 0)
+        {
+            switch (rcMode.rcMode)
+            {
+            case ENC_RC_MODE_CBR:
+                rcMode.attrH264Cbr.outBitRate = stream->bitrate;
+                break;
+            case ENC_RC_MODE_VBR:
+                rcMode.attrH264Vbr.maxBitRate = stream->bitrate;
+                break;
+            case ENC_RC_MODE_SMART:
+#if defined(PLATFORM_T30)
+                if (chnAttr.encAttr.enType == PT_H265)
+                    rcMode.attrH265Smart.maxBitRate = stream->bitrate;
+                else
+#endif
+                rcMode.attrH264Smart.maxBitRate = stream->bitrate;
+                break;
+            default:
+                break;
+            }
+            ret = IMP_Encoder_SetChnAttrRcMode(encChn, &rcMode);
+        }
+        LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnAttrRcMode(" << encChn << ", " << stream->bitrate << ")");
+#endif
+        if (ret == 0)
+            bitrate = stream->bitrate;
+    }
+
+    if (stream->gop != gop)
+    {
+#if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
+        ret = IMP_Encoder_SetChnGopLength(encChn, stream->gop);
+        LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnGopLength(" << encChn << ", " << stream->gop << ")");
+#endif
+        // the older platforms only use max_gop
+        if (ret == 0)
+            gop = stream->gop;
+    }
+
+    if (stream->fps != fps && stream->fps <= sourceFps)
+    {
+        IMPEncoderFrmRate frmRate{};
+        frmRate.frmRateNum = stream->fps;
+        frmRate.frmRateDen = 1;
+        ret = IMP_Encoder_SetChnFrmRate(encChn, &frmRate);
+        LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnFrmRate(" << encChn << ", " << stream->fps << ")");
+        if (ret == 0)
+            fps = stream->fps;
+    }
+
+    return ret;
+}
+
 int IMPEncoder::deinit()
 {
     LOG_DEBUG("IMPEncoder::deinit(" << encChn << ", " << encGrp << ")");
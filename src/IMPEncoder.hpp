@@ -48,14 +48,27 @@ public:
     int init();
     int deinit();
     int destroy();
+    int reconfigure();
     static void flush(int encChn);
 
+    // kbps the channel currently runs with, follows reconfigure()
+    int currentBitrate() const { return bitrate; }
+
+    /* fps of the framesource feeding the encoder, reconfigure() can
+     * lower the encoder fps below it but not raise it above */
+    int sourceFps{};
+
     OSD *osd = nullptr;
 
 private:
     IMPEncoderCHNAttr chnAttr{};
     void initProfile();
 
+    // parameters the encoder currently runs with, see reconfigure()
+    int bitrate{};
+    int gop{};
+    int fps{};
+
     IMPCell fs{};
     IMPCell enc{};
     IMPCell osd_cell{};
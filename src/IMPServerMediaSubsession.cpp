@@ -7,6 +7,7 @@
 #include "H265VideoRTPSink.hh"
 #include "H265VideoStreamDiscreteFramer.hh"
 #include "GroupsockHelper.hh"
+#include "BatchedGroupsock.hpp"
 #include "Config.hpp"
 
 // Modify method to accept pointers for the NAL units
@@ -28,9 +29,15 @@ IMPServerMediaSubsession::IMPServerMediaSubsession(
     H264NALUnit sps,
     H264NALUnit pps,
     int encChn)
-    : OnDemandServerMediaSubsession(env, true),
+    /* by default every client gets its own source, which replays the GOP
+     * cache and watches its own TCP send queue. With shared_packetization
+     * all clients share one source and RTP sink, live555 then sends the
+     * same packets to every destination.
+     */
+    : OnDemandServerMediaSubsession(env, cfg->rtsp.shared_packetization),
       vps(vps ? new H264NALUnit(*vps) : nullptr), // Copy if not nullptr
-      sps(sps), pps(pps), encChn(encChn)
+      sps(sps), pps(pps), encChn(encChn), lastSource(nullptr),
+      sharedSource(cfg->rtsp.shared_packetization)
 {
 }
 
@@ -48,6 +55,7 @@ FramedSource *IMPServerMediaSubsession::createNewStreamSource(
     estBitrate = cfg->rtsp.est_bitrate; // The expected bitrate?
 
     auto imp = IMPDeviceSource<H264NALUnit,video_stream>::createNew(envir(), encChn, global_video[encChn], "video");
+    lastSource = imp;
     // Here we need to decide based on the format whether to use H264 or H265 framer
     if (vps)
     {
@@ -59,6 +67,43 @@ FramedSource *IMPServerMediaSubsession::createNewStreamSource(
     }
 }
 
+/* With RTP over TCP the stream is interleaved into the RTSP connection,
+ * hand that socket to the session's source so it can watch its send queue.
+ */
+void IMPServerMediaSubsession::getStreamParameters(
+    unsigned clientSessionId, struct sockaddr_storage const &clientAddress,
+    Port const &clientRTPPort, Port const &clientRTCPPort, int tcpSocketNum,
+    unsigned char rtpChannelId, unsigned char rtcpChannelId, TLSState *tlsState,
+    struct sockaddr_storage &destinationAddress, u_int8_t &destinationTTL,
+    Boolean &isMulticast, Port &serverRTPPort, Port &serverRTCPPort,
+    void *&streamToken)
+{
+    lastSource = nullptr;
+    OnDemandServerMediaSubsession::getStreamParameters(
+        clientSessionId, clientAddress, clientRTPPort, clientRTCPPort, tcpSocketNum,
+        rtpChannelId, rtcpChannelId, tlsState, destinationAddress, destinationTTL,
+        isMulticast, serverRTPPort, serverRTCPPort, streamToken);
+
+    // a shared source must not drop frames for everybody because of one client
+    if (tcpSocketNum >= 0 && lastSource && !sharedSource)
+    {
+        lastSource->setTcpSocket(tcpSocketNum);
+    }
+    lastSource = nullptr;
+}
+
+// RTP and RTCP sockets of a client, batched if enabled
+Groupsock *IMPServerMediaSubsession::createGroupsock(
+    struct sockaddr_storage const &addr,
+    Port port)
+{
+    if (cfg->rtsp.batch_send)
+    {
+        return new BatchedGroupsock(envir(), addr, port, 255);
+    }
+    return OnDemandServerMediaSubsession::createGroupsock(addr, port);
+}
+
 // Modify RTP Sink creation to conditionally include VPS
 RTPSink *IMPServerMediaSubsession::createNewRTPSink(
     Groupsock *rtpGroupsock,
@@ -73,9 +118,9 @@ RTPSink *IMPServerMediaSubsession::createNewRTPSink(
             envir(),
             rtpGroupsock,
             rtpPayloadTypeIfDynamic,
-            &vps->data[0], vps->data.size(), // Now using pointer, check and dereference
-            &sps.data[0], sps.data.size(),
-            &pps.data[0], pps.data.size());
+            vps->data.data(), vps->data.size(), // Now using pointer, check and dereference
+            sps.data.data(), sps.data.size(),
+            pps.data.data(), pps.data.size());
     }
     else
     {
@@ -84,8 +129,8 @@ RTPSink *IMPServerMediaSubsession::createNewRTPSink(
             envir(),
             rtpGroupsock,
             rtpPayloadTypeIfDynamic,
-            &sps.data[0], sps.data.size(),
-            &pps.data[0], pps.data.size());
+            sps.data.data(), sps.data.size(),
+            pps.data.data(), pps.data.size());
     }
 
     //enabling this allows stream resolution changes
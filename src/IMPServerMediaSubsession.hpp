@@ -6,6 +6,7 @@
 #include "StreamReplicator.hh"
 #include "ServerMediaSession.hh"
 #include "OnDemandServerMediaSubsession.hh"
+#include "IMPDeviceSource.hpp"
 
 class IMPServerMediaSubsession : public OnDemandServerMediaSubsession
 {
@@ -32,11 +33,21 @@ protected:
     virtual FramedSource *createNewStreamSource(
         unsigned clientSessionId,
         unsigned &estBitrate);
+    virtual Groupsock *createGroupsock(
+        struct sockaddr_storage const &addr,
+        Port port) override;
     virtual RTPSink *createNewRTPSink(
         Groupsock *rtpGroupsock,
         unsigned char rtpPayloadTypeIfDynamic,
         FramedSource *inputSource);
 
+    virtual void getStreamParameters(unsigned clientSessionId, struct sockaddr_storage const &clientAddress,
+                                     Port const &clientRTPPort, Port const &clientRTCPPort, int tcpSocketNum,
+                                     unsigned char rtpChannelId, unsigned char rtcpChannelId, TLSState *tlsState,
+                                     struct sockaddr_storage &destinationAddress, u_int8_t &destinationTTL,
+                                     Boolean &isMulticast, Port &serverRTPPort, Port &serverRTCPPort,
+                                     void *&streamToken) override;
+
     virtual void startStream(unsigned clientSessionId, void* streamToken, TaskFunc* rtcpRRHandler,
                              void* rtcpRRHandlerClientData, unsigned short& rtpSeqNum, unsigned& rtpTimestamp,
                              ServerRequestAlternativeByteHandler* serverRequestAlternativeByteHandler,
@@ -46,15 +57,24 @@ protected:
                                                    rtpSeqNum, rtpTimestamp, serverRequestAlternativeByteHandler,
                                                    serverRequestAlternativeByteHandlerClientData);
         
-        //request idr frame every second for the next x seconds
-        global_video[encChn]->idr_fix = 5; 
-        IMPEncoder::flush(encChn);
+        /* a new source replays the cached GOP, only without one or when
+         * joining a shared source request idr frame every second for the
+         * next x seconds
+         */
+        if (sharedSource || !global_video[encChn]->msgChannel->has_gop())
+        {
+            global_video[encChn]->idr_fix = 5;
+            IMPEncoder::flush(encChn);
+        }
     }
 private:
     H264NALUnit *vps; // Change to pointer for optional VPS
     H264NALUnit sps;
     H264NALUnit pps;
     int encChn;
+    // source created by the last createNewStreamSource() call
+    IMPDeviceSource<H264NALUnit, video_stream> *lastSource;
+    bool sharedSource;
 };
 
 #endif
@@ -0,0 +1,113 @@
+#ifndef LockOrder_hpp
+#define LockOrder_hpp
+
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+
+/* Lock hierarchy of the daemon. A thread holding a lock may only take
+ * locks of a lower level, the levels below are ordered innermost first.
+ */
+enum LockLevel
+{
+    LOCK_LEVEL_CALLBACK = 1, // audio_stream::onDataCallbackLock
+    LOCK_LEVEL_STREAM,       // per stream state, video / audio / jpeg
+    LOCK_LEVEL_RESTART       // restart flags, main thread wakeup
+};
+
+/* std::mutex which knows its place in the lock hierarchy.
+ * Built with LOCK_ORDER_CHECK (unstripped debug builds), every lock()
+ * verifies the order against the locks the thread already holds and
+ * aborts on a violation. Otherwise it is a plain std::mutex.
+ * Use std::condition_variable_any to wait on it.
+ */
+class OrderedMutex
+{
+public:
+    OrderedMutex(LockLevel level, const char *name) : level(level), name(name) {}
+    OrderedMutex(const OrderedMutex &) = delete;
+    OrderedMutex &operator=(const OrderedMutex &) = delete;
+
+    void lock()
+    {
+        check();
+        mtx.lock();
+        push();
+    }
+
+    bool try_lock()
+    {
+        // a try_lock can't deadlock, no order check
+        if (!mtx.try_lock())
+            return false;
+        push();
+        return true;
+    }
+
+    void unlock()
+    {
+        pop();
+        mtx.unlock();
+    }
+
+private:
+#if defined(LOCK_ORDER_CHECK)
+    static constexpr int max_held = 8;
+
+    struct Held
+    {
+        const OrderedMutex *held[max_held];
+        int count;
+    };
+
+    static Held &held()
+    {
+        static thread_local Held h{};
+        return h;
+    }
+
+    void check() const
+    {
+        Held &h = held();
+        for (int i = 0; i < h.count; i++)
+        {
+            if (h.held[i] == this || h.held[i]->level <= level)
+            {
+                fprintf(stderr, "lock order violation: %s (level %d) taken while holding %s (level %d)\n",
+                        name, level, h.held[i]->name, h.held[i]->level);
+                abort();
+            }
+        }
+    }
+
+    void push()
+    {
+        Held &h = held();
+        if (h.count < max_held)
+            h.held[h.count++] = this;
+    }
+
+    void pop()
+    {
+        Held &h = held();
+        for (int i = h.count - 1; i >= 0; i--)
+        {
+            if (h.held[i] == this)
+            {
+                h.held[i] = h.held[--h.count];
+                return;
+            }
+        }
+    }
+#else
+    void check() const {}
+    void push() {}
+    void pop() {}
+#endif
+
+    std::mutex mtx;
+    const LockLevel level;
+    const char *name;
+};
+
+#endif
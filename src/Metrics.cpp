@@ -0,0 +1,179 @@
+#include "Metrics.hpp"
+#include <cstring>
+#include <time.h>
+
+Metrics &Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+unsigned int Metrics::shard()
+{
+    static std::atomic<unsigned int> next{0};
+    static thread_local unsigned int idx = next.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+    return idx;
+}
+
+uint64_t Metrics::Counter::value() const
+{
+    std::lock_guard lock {fold_mtx};
+    for (int i = 0; i < METRIC_SHARDS; i++)
+    {
+        uint32_t v = shards[i].value.load(std::memory_order_relaxed);
+        total += (uint32_t)(v - folded[i]);
+        folded[i] = v;
+    }
+    return total;
+}
+
+void Metrics::Histogram::observe(int64_t us)
+{
+    if (us < 0)
+        us = 0;
+
+    size_t i = 0;
+    while (i < num_buckets - 1 && us > bounds[i])
+        i++;
+
+    // a single observation above an hour is clamped
+    if (us > 3600000000LL)
+        us = 3600000000LL;
+
+    Shard &s = shards[shard()];
+    s.buckets[i].fetch_add(1, std::memory_order_relaxed);
+    s.sum_us.fetch_add((uint32_t)us, std::memory_order_relaxed);
+}
+
+Metrics::Histogram::Snapshot Metrics::Histogram::snapshot() const
+{
+    std::lock_guard lock {fold_mtx};
+    for (int s = 0; s < METRIC_SHARDS; s++)
+    {
+        for (size_t i = 0; i < num_buckets; i++)
+        {
+            uint32_t v = shards[s].buckets[i].load(std::memory_order_relaxed);
+            total.buckets[i] += (uint32_t)(v - folded_buckets[s][i]);
+            folded_buckets[s][i] = v;
+        }
+        uint32_t sum = shards[s].sum_us.load(std::memory_order_relaxed);
+        total.sum_us += (uint32_t)(sum - folded_sum[s]);
+        folded_sum[s] = sum;
+    }
+    total.count = 0;
+    for (auto n : total.buckets)
+        total.count += n;
+    return total;
+}
+
+uint32_t Metrics::Histogram::Snapshot::percentile(double q) const
+{
+    if (count == 0)
+        return 0;
+
+    double rank = q * count;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets; i++)
+    {
+        if (buckets[i] == 0 || seen + buckets[i] < rank)
+        {
+            seen += buckets[i];
+            continue;
+        }
+        // the overflow bucket has no upper bound, report its lower one
+        if (i == num_buckets - 1)
+            return bounds[i - 1];
+        uint32_t lower = i ? bounds[i - 1] : 0;
+        return lower + (uint32_t)((bounds[i] - lower) * (rank - seen) / buckets[i]);
+    }
+    return bounds[num_buckets - 2];
+}
+
+Metrics::Entry &Metrics::entry(const char *name, const char *help, const std::string &labels, Type type)
+{
+    std::lock_guard lock {mtx};
+    for (auto &e : entries)
+    {
+        if (e->type == type && strcmp(e->name, name) == 0 && e->labels == labels)
+            return *e;
+    }
+
+    auto e = std::make_unique<Entry>();
+    e->name = name;
+    e->labels = labels;
+    e->help = help;
+    e->type = type;
+    switch (type)
+    {
+    case COUNTER:
+        e->counter = std::make_unique<Counter>();
+        break;
+    case GAUGE:
+        e->gauge = std::make_unique<Gauge>();
+        break;
+    case HISTOGRAM:
+        e->histogram = std::make_unique<Histogram>();
+        break;
+    }
+    entries.push_back(std::move(e));
+    return *entries.back();
+}
+
+Metrics::Counter &Metrics::counter(const char *name, const char *help, const std::string &labels)
+{
+    return *entry(name, help, labels, COUNTER).counter;
+}
+
+Metrics::Gauge &Metrics::gauge(const char *name, const char *help, const std::string &labels)
+{
+    return *entry(name, help, labels, GAUGE).gauge;
+}
+
+Metrics::Histogram &Metrics::histogram(const char *name, const char *help, const std::string &labels)
+{
+    return *entry(name, help, labels, HISTOGRAM).histogram;
+}
+
+std::vector<Metrics::Sample> Metrics::snapshot()
+{
+    std::vector<Sample> samples;
+    std::lock_guard lock {mtx};
+    samples.reserve(entries.size());
+    for (auto &e : entries)
+    {
+        Sample s{e->name, e->labels, e->help, e->type, 0, {}};
+        switch (e->type)
+        {
+        case COUNTER:
+            s.value = e->counter->value();
+            break;
+        case GAUGE:
+            s.value = e->gauge->value();
+            break;
+        case HISTOGRAM:
+            s.histogram = e->histogram->snapshot();
+            break;
+        }
+        samples.push_back(std::move(s));
+    }
+    return samples;
+}
+
+void Metrics::fold()
+{
+    std::lock_guard lock {mtx};
+    for (auto &e : entries)
+    {
+        if (e->counter)
+            e->counter->value();
+        if (e->histogram)
+            e->histogram->snapshot();
+    }
+}
+
+int64_t metrics_elapsed_us(int64_t monotonic_us)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000000LL + now.tv_nsec / 1000) - monotonic_us;
+}
@@ -0,0 +1,158 @@
+#ifndef Metrics_hpp
+#define Metrics_hpp
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// shards per metric, threads are spread over them round robin
+#define METRIC_SHARDS 4
+
+/* Process wide registry of counters, gauges and latency histograms.
+ * A metric is registered once, which takes a lock, and lives as long as the
+ * process, so callers keep the returned reference. Updates are relaxed
+ * atomic adds into the shard of the calling thread, threads updating the
+ * same metric don't share a cache line. The shards are 32 bit, MIPS32 has
+ * no 64 bit atomics. Reading a metric folds the shard increments since
+ * the last read into 64 bit totals, fold() does so for all metrics and
+ * is called every second, long before a shard can wrap around. Reads
+ * never block an update, the result is consistent per shard only.
+ */
+class Metrics
+{
+public:
+    enum Type
+    {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM
+    };
+
+    // monotonic count of events
+    class Counter
+    {
+    public:
+        void add(uint32_t n = 1) { shards[shard()].value.fetch_add(n, std::memory_order_relaxed); }
+        uint64_t value() const;
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::atomic<uint32_t> value{0};
+        };
+        Shard shards[METRIC_SHARDS];
+
+        // read side, shard values at the last fold and their 64 bit sum
+        mutable std::mutex fold_mtx;
+        mutable uint32_t folded[METRIC_SHARDS]{};
+        mutable uint64_t total{0};
+    };
+
+    // momentary value, set by a single writer
+    class Gauge
+    {
+    public:
+        void set(int32_t v) { value_.store(v, std::memory_order_relaxed); }
+        void add(int32_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+        int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<int32_t> value_{0};
+    };
+
+    /* Latency distribution in microseconds, with the same fixed buckets
+     * for every histogram, so snapshots can be compared and summed.
+     * Exported in seconds, name them *_seconds.
+     */
+    class Histogram
+    {
+    public:
+        // bucket upper bounds in µs, the last bucket counts everything above
+        static constexpr uint32_t bounds[] = {100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+                                              50000, 100000, 250000, 500000, 1000000};
+        static constexpr size_t num_buckets = sizeof(bounds) / sizeof(bounds[0]) + 1;
+
+        struct Snapshot
+        {
+            uint64_t buckets[num_buckets]{};
+            uint64_t count{0};
+            uint64_t sum_us{0};
+
+            // estimated q quantile (0..1) in µs, interpolated within its bucket
+            uint32_t percentile(double q) const;
+        };
+
+        void observe(int64_t us);
+        Snapshot snapshot() const;
+
+    private:
+        struct alignas(64) Shard
+        {
+            std::atomic<uint32_t> buckets[num_buckets]{};
+            std::atomic<uint32_t> sum_us{0};
+        };
+        Shard shards[METRIC_SHARDS];
+
+        // read side, see Counter
+        mutable std::mutex fold_mtx;
+        mutable uint32_t folded_buckets[METRIC_SHARDS][num_buckets]{};
+        mutable uint32_t folded_sum[METRIC_SHARDS]{};
+        mutable Snapshot total;
+    };
+
+    struct Sample
+    {
+        std::string name;
+        std::string labels; // prometheus label list without braces, may be empty
+        const char *help;
+        Type type;
+        int64_t value;      // counter and gauge
+        Histogram::Snapshot histogram;
+    };
+
+    static Metrics &instance();
+
+    /* Register a metric or return the one registered with the same name
+     * and labels before. labels is a prometheus label list, e.g.
+     * stream="stream0". name and help must be string literals.
+     */
+    Counter &counter(const char *name, const char *help, const std::string &labels = "");
+    Gauge &gauge(const char *name, const char *help, const std::string &labels = "");
+    Histogram &histogram(const char *name, const char *help, const std::string &labels = "");
+
+    // current values of all metrics, in registration order
+    std::vector<Sample> snapshot();
+
+    // widen the shards of all metrics into their totals, call every second
+    void fold();
+
+    // shard of the calling thread
+    static unsigned int shard();
+
+private:
+    struct Entry
+    {
+        const char *name;
+        std::string labels;
+        const char *help;
+        Type type;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    Metrics() = default;
+    Entry &entry(const char *name, const char *help, const std::string &labels, Type type);
+
+    std::mutex mtx;
+    std::vector<std::unique_ptr<Entry>> entries;
+};
+
+// µs since a CLOCK_MONOTONIC based time point, e.g. an IMP timestamp
+int64_t metrics_elapsed_us(int64_t monotonic_us);
+
+#endif
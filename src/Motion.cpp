@@ -85,7 +85,7 @@ void Motion::detect()
                             LOG_ERROR("Motion script failed:" << cmd);
                         }
                     }
-                    indicator = true;
+                    global_motion_indicator = true;
                     motionEndTime = steady_clock::now(); // Update last motion time
                 }
             }
@@ -107,7 +107,7 @@ void Motion::detect()
                     LOG_ERROR("Motion script failed:" << cmd);
                 }
                 moving = false;
-                indicator = false;
+                global_motion_indicator = false;
                 cooldownEndTime = steady_clock::now(); // Start cooldown
                 isInCooldown = true;
             }
@@ -224,6 +224,8 @@ int Motion::exit()
 
     LOG_DEBUG("Exit motion detection.");
 
+    global_motion_indicator = false;
+
     ret = IMP_IVS_StopRecvPic(ivsChn);
     LOG_DEBUG_OR_ERROR(ret, "IMP_IVS_StopRecvPic(0)");
 
@@ -1,60 +1,135 @@
 #ifndef MsgChannel_hpp
 #define MsgChannel_hpp
 
-#include <iostream>
-#include <deque>
-#include <thread>
 #include <atomic>
-#include <mutex>
-#include <condition_variable>
+#include <memory>
+#include <cstdint>
 
-/* Implementation of the MsgChannel API, except that it keeps 
+/* Implementation of the MsgChannel API, except that it keeps
  * the most recent bsize elements in the queue.
+ *
+ * Bounded lock-free ring (Vyukov MPMC), every cell carries a sequence
+ * number telling whether it is ready to be written or read. Writers
+ * make room by dropping the oldest element themselves. Readers only
+ * park in wait_read(), writers notify only when somebody is parked.
+ * All counters are 32 bit, MIPS32 has no 64 bit atomics.
  */
 template <class T> class MsgChannel {
 public:
-    MsgChannel(unsigned int bsize) : buffer_size{bsize} { }
+    MsgChannel(unsigned int bsize)
+        : buffer_size{bsize ? bsize : 1}, mask{capacity_for(buffer_size) - 1},
+          cells{new Cell[mask + 1]}
+    {
+        for (uint32_t i = 0; i <= mask; ++i)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
 
+    // returns false if an old element had to be dropped
     bool write(T msg) {
-        std::unique_lock<std::mutex> lck(cv_mtx);
-        msg_buffer.push_front(msg);
-        if (msg_buffer.size() > buffer_size) {
-            msg_buffer.pop_back();
-            return false;
+        bool dropped = false;
+        T old;
+        while (size() >= buffer_size && pop(&old))
+            dropped = true;
+        while (!push(msg)) {
+            if (pop(&old))
+                dropped = true;
         }
-        write_cv.notify_all();
-        return true;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            signal.fetch_add(1, std::memory_order_release);
+            signal.notify_all();
+        }
+        return !dropped;
     }
 
     bool read(T *out) {
-        std::unique_lock<std::mutex> lck(cv_mtx);
-        if (can_read()) {
-            *out = msg_buffer.back();
-            msg_buffer.pop_back();
-            return true;
-        }
-        return false;
+        return pop(out);
     }
 
     T wait_read() {
-        std::unique_lock<std::mutex> lck(cv_mtx);
-        while (!can_read()) {
-            write_cv.wait(lck);
-        };
-        T val = msg_buffer.back();
-        msg_buffer.pop_back();
+        T val;
+        while (!pop(&val)) {
+            uint32_t ticket = signal.load(std::memory_order_acquire);
+            waiters.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool ready = pop(&val);
+            if (!ready)
+                signal.wait(ticket, std::memory_order_acquire);
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+            if (ready)
+                break;
+        }
         return val;
     }
 
 private:
-    bool can_read() {
-        return !msg_buffer.empty();
+    struct Cell {
+        std::atomic<uint32_t> seq;
+        T data;
+    };
+
+    static uint32_t capacity_for(uint32_t n) {
+        uint32_t cap = 1;
+        while (cap < n)
+            cap <<= 1;
+        return cap;
+    }
+
+    uint32_t size() const {
+        uint32_t tail = dequeue_pos.load(std::memory_order_relaxed);
+        return enqueue_pos.load(std::memory_order_relaxed) - tail;
     }
 
-    std::deque<T> msg_buffer;
-    std::mutex cv_mtx;
-    std::condition_variable write_cv;
-    unsigned int buffer_size;
+    bool push(T &msg) {
+        Cell *cell;
+        uint32_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & mask];
+            int32_t dif = static_cast<int32_t>(cell->seq.load(std::memory_order_acquire) - pos);
+            if (dif == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (dif < 0) {
+                return false; // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(msg);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T *out) {
+        Cell *cell;
+        uint32_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & mask];
+            int32_t dif = static_cast<int32_t>(cell->seq.load(std::memory_order_acquire) - (pos + 1));
+            if (dif == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (dif < 0) {
+                return false; // empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        *out = std::move(cell->data);
+        cell->data = T(); // do not keep payload references alive in the ring
+        cell->seq.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    const uint32_t buffer_size;
+    const uint32_t mask;
+    std::unique_ptr<Cell[]> cells;
+
+    alignas(64) std::atomic<uint32_t> enqueue_pos{0};
+    alignas(64) std::atomic<uint32_t> dequeue_pos{0};
+    alignas(64) std::atomic<uint32_t> signal{0};
+    std::atomic<uint32_t> waiters{0};
 };
 
 #endif
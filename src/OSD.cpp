@@ -3,6 +3,7 @@
 #include "OSD.hpp"
 #include "Config.hpp"
 #include "Logger.hpp"
+#include "globals.hpp"
 
 #if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
 #define IMPEncoderCHNAttr IMPEncoderChnAttr
@@ -17,159 +18,96 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 #include <fstream>
 
 #include "schrift.h"
 
-int OSD::renderGlyph(const char *characters)
+// BGRA pixels from the alpha planes, transparent pixels are left untouched
+static void compose_row(uint8_t *image, const uint8_t *text, const uint8_t *alpha, int n,
+                        const uint8_t (*color)[3])
 {
-
-    while (*characters)
+    for (int i = 0; i < n; ++i)
     {
-
-        SFT_LMetrics lmetrics;
-        SFT_GMetrics gmetrics;
-        SFT_Glyph glyph;
-        SFT_Image imageBuffer;
-
-        if (sft_lmetrics(sft, &lmetrics) == 0 && sft_lookup(sft, *characters, &glyph) == 0)
+        if (alpha[i])
         {
-            if (sft_gmetrics(sft, glyph, &gmetrics) == 0)
-            {
-                imageBuffer.width = gmetrics.minWidth;
-                imageBuffer.height = gmetrics.minHeight;
-                imageBuffer.pixels = (uint8_t *)malloc(imageBuffer.width * imageBuffer.height);
-
-                if (sft_render(sft, glyph, imageBuffer) == 0)
-                {
-                    Glyph g;
-                    g.width = imageBuffer.width;
-                    g.height = imageBuffer.height;
-                    g.advance = gmetrics.advanceWidth;
-                    g.xmin = gmetrics.leftSideBearing;
-                    g.ymin = gmetrics.yOffset;
-                    g.glyph = glyph;
-
-                    g.bitmap.resize(g.width * g.height * 4);
-                    for (int y = 0; y < g.height; ++y)
-                    {
-                        for (int x = 0; x < g.width; ++x)
-                        {
-                            int pixelIndex = y * g.width + x;
-                            uint8_t alpha = ((uint8_t *)imageBuffer.pixels)[pixelIndex];
-                            if (alpha > 0)
-                            {
-                                g.bitmap[pixelIndex * 4] = BGRA_TEXT[0];
-                                g.bitmap[pixelIndex * 4 + 1] = BGRA_TEXT[1];
-                                g.bitmap[pixelIndex * 4 + 2] = BGRA_TEXT[2];
-                                g.bitmap[pixelIndex * 4 + 3] = alpha;
-                            }
-                        }
-                    }
-
-                    glyphs[*characters] = g;
-                }
-                free(imageBuffer.pixels);
-            }
+            const uint8_t *c = color[text[i]];
+            image[i * 4] = c[0];
+            image[i * 4 + 1] = c[1];
+            image[i * 4 + 2] = c[2];
+            image[i * 4 + 3] = alpha[i];
         }
-        ++characters;
     }
-
-    return 0;
 }
 
-void setPixel(uint8_t *image, int x, int y, const uint8_t *color, int WIDTH, int HEIGHT)
+// Digits share the advance of the widest one, so counters keep their layout
+int OSD::glyphAdvance(char c, const Glyph &g)
 {
-    if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
-    {
-        int index = (y * WIDTH + x) * 4;
-        image[index] = color[0];     // B
-        image[index + 1] = color[1]; // G
-        image[index + 2] = color[2]; // R
-        image[index + 3] = color[3]; // A
-    }
+    return (c >= '0' && c <= '9') ? font->digitAdvance : g.advance;
 }
 
-void OSD::drawOutline(uint8_t* image, const Glyph& g, int x, int y, int outlineSize, int WIDTH, int HEIGHT) {
-    for (int j = -outlineSize; j <= outlineSize; ++j) {
-        for (int i = -outlineSize; i <= outlineSize; ++i) {
-            if (i * i + j * j <= outlineSize * outlineSize) { // Use circular distance
-                for (int h = 0; h < g.height; ++h) {
-                    for (int w = 0; w < g.width; ++w) {
-                        int srcIndex = (h * g.width + w) * 4;
-                        if (g.bitmap[srcIndex + 3] > 0) { // Check alpha value
-                            setPixel(image, x + w + i, y + h + j, BGRA_STROKE, WIDTH, HEIGHT);
-                        }
-                    }
-                }
-            }
-        }
-    }
-}
-/*
-void OSD::drawOutline(uint8_t *image, const Glyph &g, int x, int y, int outlineSize, int WIDTH, int HEIGHT)
-{
-    for (int j = -outlineSize; j <= outlineSize; ++j)
-    {
-        for (int i = -outlineSize; i <= outlineSize; ++i)
-        {
-            if (abs(i) + abs(j) <= outlineSize)
-            { // Use Manhattan distance
-                for (int h = 0; h < g.height; ++h)
-                {
-                    for (int w = 0; w < g.width; ++w)
-                    {
-                        int srcIndex = (h * g.width + w) * 4;
-                        if (g.bitmap[srcIndex + 3] > 0)
-                        { // Check alpha value
-                            setPixel(image, x + w + i, y + h + j, BGRA_STROKE, WIDTH, HEIGHT);
-                        }
-                    }
-                }
-            }
-        }
-    }
-}
-*/
-int OSD::drawText(uint8_t *image, const char *text, int WIDTH, int HEIGHT, int outlineSize)
+int OSD::drawText(uint8_t *image, const char *text, int WIDTH, int HEIGHT, int outlineSize, int clipX0, int clipX1)
 {
     int penX = 1;
     int penY = 1;
 
-    // Draw text and outline
+    if (clipX1 < 0)
+        clipX1 = WIDTH;
+    int span = clipX1 - clipX0;
+
+    textPlane.resize(WIDTH * HEIGHT);
+    if (outlineSize)
+        strokePlane.resize(WIDTH * HEIGHT);
+    for (int j = 0; j < HEIGHT; ++j)
+    {
+        memset(&textPlane[j * WIDTH + clipX0], 0, span);
+        if (outlineSize)
+            memset(&strokePlane[j * WIDTH + clipX0], 0, span);
+        memset(image + (j * WIDTH + clipX0) * 4, 0, span * 4);
+    }
+
+    // Merge the glyph cells into the alpha planes
     while (*text)
     {
-        auto it = glyphs.find(*text);
-        if (it != glyphs.end())
+        auto it = font->glyphs.find(*text);
+        if (it != font->glyphs.end())
         {
             const Glyph &g = it->second;
+            int advance = glyphAdvance(*text, g);
 
-            int x = penX + g.xmin + outlineSize;
-            int y = penY + (sft->yScale + g.ymin);
+            // cell origin, the glyph itself is outlineSize further in
+            int x = penX + g.xmin + (advance - g.advance) / 2;
+            int y = penY + (font->sft.yScale + g.ymin) - outlineSize;
 
-            // Draw the outline
-            drawOutline(image, g, x, y, outlineSize, WIDTH, HEIGHT);
+            int x0 = std::max(0, clipX0 - x);
+            int y0 = std::max(0, -y);
+            int x1 = std::min(g.cellWidth, clipX1 - x);
+            int y1 = std::min(g.cellHeight, HEIGHT - y);
 
-            // Draw the actual text
-            for (int j = 0; j < g.height; ++j)
+            for (int j = y0; j < y1 && x0 < x1; ++j)
             {
-                for (int i = 0; i < g.width; ++i)
-                {
-                    int srcIndex = (j * g.width + i) * 4;
-                    if (g.bitmap[srcIndex + 3] > 0)
-                    { // Check alpha value
-                        setPixel(image, x + i, y + j, &g.bitmap[srcIndex], WIDTH, HEIGHT);
-                    }
-                }
+                int dst = (y + j) * WIDTH + x + x0;
+                int src = j * g.cellWidth + x0;
+                Font::maxRow(&textPlane[dst], &font->atlas[g.text + src], x1 - x0);
+                if (outlineSize)
+                    Font::maxRow(&strokePlane[dst], &font->atlas[g.stroke + src], x1 - x0);
             }
 
-            penX += g.advance + (outlineSize * 2);
+            penX += advance + (outlineSize * 2);
         }
         ++text;
     }
 
+    const uint8_t *alpha = outlineSize ? strokePlane.data() : textPlane.data();
+    for (int j = 0; j < HEIGHT; ++j)
+    {
+        int row = j * WIDTH + clipX0;
+        compose_row(image + row * 4, &textPlane[row], alpha + row, span, font->textColor);
+    }
+
     return 0;
 }
 
@@ -180,12 +118,12 @@ int OSD::calculateTextSize(const char *text, uint16_t &width, uint16_t &height,
 
     while (*text)
     {
-        auto it = glyphs.find(*text);
-        if (it != glyphs.end())
+        auto it = font->glyphs.find(*text);
+        if (it != font->glyphs.end())
         {
             const Glyph &g = it->second;
 
-            width += g.advance + (outlineSize * 2);
+            width += glyphAdvance(*text, g) + (outlineSize * 2);
             if (g.height > height)
             {
                 height = g.height;
@@ -195,63 +133,125 @@ int OSD::calculateTextSize(const char *text, uint16_t &width, uint16_t &height,
         ++text;
     }
 
-    height += sft->yScale;
+    height += font->sft.yScale;
     width += 1 + outlineSize;
 
     return 0;
 }
 
+/* The columns [x0, x1) of a text bitmap which differ between the texts from
+ * and to, drawn at the same size. Glyphs which changed or moved are dirty
+ * as far as their cells reach. Returns false if nothing changed.
+ */
+bool OSD::textDamage(const char *from, const char *to, int outlineSize, int WIDTH, int &x0, int &x1)
+{
+    int penFrom = 1;
+    int penTo = 1;
+
+    x0 = WIDTH;
+    x1 = 0;
+
+    auto mark = [&](int penX, char c)
+    {
+        auto it = font->glyphs.find(c);
+        if (it != font->glyphs.end())
+        {
+            const Glyph &g = it->second;
+            int x = penX + g.xmin + (glyphAdvance(c, g) - g.advance) / 2;
+            x0 = std::min(x0, x);
+            x1 = std::max(x1, x + g.cellWidth);
+        }
+    };
+
+    auto advance = [&](int &penX, const char *&text)
+    {
+        if (*text)
+        {
+            auto it = font->glyphs.find(*text);
+            if (it != font->glyphs.end())
+                penX += glyphAdvance(*text, it->second) + (outlineSize * 2);
+            ++text;
+        }
+    };
+
+    while (*from || *to)
+    {
+        if (*from != *to || penFrom != penTo)
+        {
+            mark(penFrom, *from);
+            mark(penTo, *to);
+        }
+        advance(penFrom, from);
+        advance(penTo, to);
+    }
+
+    x0 = std::max(x0, 0);
+    x1 = std::min(x1, WIDTH);
+
+    return x0 < x1;
+}
+
 int OSD::libschrift_init()
 {
     LOG_DEBUG("OSD::libschrift_init()");
 
-    std::ifstream fontFile(osd.font_path, std::ios::binary | std::ios::ate);
-    if (!fontFile.is_open())
+    FontStyle style;
+    style.path = osd.font_path;
+    style.xScale = osd.font_size * osd.font_xscale / 100;
+    style.yScale = osd.font_size * osd.font_yscale / 100;
+    style.yOffset = osd.font_yoffset;
+    style.stroke = osd.font_stroke;
+    style.color = osd.font_color;
+    style.strokeColor = osd.font_stroke_color;
+
+    // the other stream's OSD has loaded it already if it uses the same style
+    font = FontCache::instance().get(style);
+    if (!font)
     {
-        LOG_DEBUG("Unable to open font file.");
         return -1;
     }
 
-    BGRA_TEXT[2] = (osd.font_color >> 16) & 0xFF;
-    BGRA_TEXT[1] = (osd.font_color >> 8) & 0xFF;
-    BGRA_TEXT[0] = (osd.font_color >> 0) & 0xFF;
-    BGRA_TEXT[3] = 0;
-
-    BGRA_STROKE[2] = (osd.font_stroke_color >> 16) & 0xFF;
-    BGRA_STROKE[1] = (osd.font_stroke_color >> 8) & 0xFF;
-    BGRA_STROKE[0] = (osd.font_stroke_color >> 0) & 0xFF;
-    BGRA_STROKE[3] = 255;
-
-    size_t fileSize = fontFile.tellg();
-    std::vector<uint8_t> fontData;
-    fontFile.seekg(0, std::ios::beg);
-    fontData.resize(fileSize);
-    fontFile.read(reinterpret_cast<char *>(fontData.data()), fileSize);
-    fontFile.close();
-
-    sft = new SFT();
-    sft->flags = SFT_DOWNWARD_Y;
-    sft->xScale = osd.font_size * osd.font_xscale / 100;
-    sft->yScale = osd.font_size * osd.font_yscale / 100;
-    sft->yOffset = osd.font_yoffset;
-    sft->font = sft_loadmem(fontData.data(), fontData.size());
-    if (!sft->font)
-    {
-        LOG_DEBUG("Unable to load font data.");
-        return -1;
-    }
+    return 0;
+}
 
-    renderGlyph("01234567890abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!§$%&/()=?,.-_:;#'+*~}{} ");
+/* Widens a BGRA image of odd width by a transparent column, text regions
+ * are kept at even widths. The image is reallocated.
+ */
+static void padToEvenWidth(uint8_t *&image, uint16_t &width, uint16_t height)
+{
+    if (width % 2 == 0)
+        return;
 
-    fontData.clear();
-    return 0;
+    int stride = (width + 1) * 4;
+    auto *padded = (uint8_t *)malloc(stride * height);
+    for (int y = 0; y < height; ++y)
+    {
+        memcpy(padded + y * stride, image + y * width * 4, width * 4);
+        memset(padded + y * stride + width * 4, 0, 4);
+    }
+    free(image);
+    image = padded;
+    ++width;
 }
 
-void OSD::set_text(OSDItem *osdItem, IMPOSDRgnAttr *rgnAttr, const char *text, int posX, int posY, int angle)
+void OSD::set_text(OSDItem *osdItem, const char *text, int posX, int posY, int angle)
 {
 
     // size and stroke
     uint8_t stroke_width = osd.font_stroke;
+    bool restyled = font && stroke_width != font->style.stroke;
+    if (restyled)
+        libschrift_init();
+    if (!font)
+        return;
+
+    // the region shows this text already
+    if (osdItem->data && !restyled && osdItem->text == text)
+        return;
+
+    // the other stream may have drawn the same text with this font already
+    bool shared = font.use_count() > 1;
+
     uint16_t item_width = 0;
     uint16_t item_height = 0;
 
@@ -260,44 +260,68 @@ void OSD::set_text(OSDItem *osdItem, IMPOSDRgnAttr *rgnAttr, const char *text, i
     if (item_width % 2 != 0)
         ++item_width;
 
-    int item_size = item_width * item_height * 4;
-
-    free(osdItem->data);
-    osdItem->data = (uint8_t *)malloc(item_size);
-    memset(osdItem->data, 0, item_size);
-
-    drawText(osdItem->data, text, item_width, item_height, stroke_width);
-
-    if (angle)
+    // same size, redraw the changed glyphs in place
+    if (osdItem->data && !restyled && !angle &&
+        item_width == osdItem->width && item_height == osdItem->height)
     {
-        rotateBGRAImage(osdItem->data, item_width, item_height, angle, true);
+        if (!shared || !font->findText(text, angle, osdItem->data, item_width, item_height))
+        {
+            int x0, x1;
+            if (textDamage(osdItem->text.c_str(), text, stroke_width, item_width, x0, x1))
+            {
+                drawText(osdItem->data, text, item_width, item_height, stroke_width, x0, x1);
+            }
+            if (shared)
+                font->storeText(text, angle, item_width, item_height, osdItem->data);
+        }
+        osdItem->text = text;
+
+        set_image(osdItem, item_width, item_height, posX, posY);
+        return;
     }
 
-    if (item_width != osdItem->width || item_height != osdItem->height)
+    if (!shared || !font->findText(text, angle, osdItem->data, item_width, item_height))
     {
-        if (rgnAttr == nullptr)
+        int item_size = item_width * item_height * 4;
+
+        free(osdItem->data);
+        osdItem->data = (uint8_t *)malloc(item_size);
+
+        drawText(osdItem->data, text, item_width, item_height, stroke_width);
+
+        if (angle)
         {
-            rgnAttr = new IMPOSDRgnAttr();
-            IMP_OSD_GetRgnAttr(osdItem->imp_rgn, rgnAttr);
+            // the width is the text height after a right angle rotation
+            rotateBGRAImage(osdItem->data, item_width, item_height, angle, true);
+            padToEvenWidth(osdItem->data, item_width, item_height);
         }
 
-        set_pos(rgnAttr, posX, posY, item_width, item_height, stream_width, stream_height);
+        if (shared)
+            font->storeText(text, angle, item_width, item_height, osdItem->data);
+    }
+    osdItem->text = text;
+
+    set_image(osdItem, item_width, item_height, posX, posY);
+}
+
+// Hands the bitmap in osdItem->data to the SDK, the region is moved if the size changed
+void OSD::set_image(OSDItem *osdItem, uint16_t width, uint16_t height, int posX, int posY)
+{
+    osdItem->rgnAttr.data.picData.pData = osdItem->data;
 
-        rgnAttr->data.picData.pData = osdItem->data;
-        osdItem->rgnAttrData = &rgnAttr->data;
+    if (width != osdItem->width || height != osdItem->height)
+    {
+        set_pos(&osdItem->rgnAttr, posX, posY, width, height, stream_width, stream_height);
 
-        osdItem->width = item_width;
-        osdItem->height = item_height;
+        osdItem->width = width;
+        osdItem->height = height;
 
-        IMP_OSD_SetRgnAttr(osdItem->imp_rgn, rgnAttr);
+        IMP_OSD_SetRgnAttr(osdItem->imp_rgn, &osdItem->rgnAttr);
     }
     else
     {
-        osdItem->rgnAttrData->picData.pData = osdItem->data;
-        IMP_OSD_UpdateRgnAttrData(osdItem->imp_rgn, osdItem->rgnAttrData);
+        IMP_OSD_UpdateRgnAttrData(osdItem->imp_rgn, &osdItem->rgnAttr.data);
     }
-
-    return;
 }
 
 unsigned long getSystemUptime()
@@ -355,8 +379,77 @@ void replace(std::string& str, const std::string& oldToken, const std::string& n
     }
 }
 
+// pixels per side of the blocks right angle rotations work in
+#define ROTATE_BLOCK 16
+
+/* Rotates a BGRA image by 90 degrees clockwise, or counterclockwise for
+ * 270, into dst of height x width. The image is walked in square blocks,
+ * so the column writes of a block hit the same few cache lines.
+ */
+template <bool clockwise>
+static void rotateRightAngle(uint8_t *dst, const uint8_t *src, int width, int height)
+{
+    for (int by = 0; by < height; by += ROTATE_BLOCK)
+    {
+        int ey = std::min(by + ROTATE_BLOCK, height);
+        for (int bx = 0; bx < width; bx += ROTATE_BLOCK)
+        {
+            int ex = std::min(bx + ROTATE_BLOCK, width);
+            for (int y = by; y < ey; ++y)
+            {
+                for (int x = bx; x < ex; ++x)
+                {
+                    int to = clockwise ? x * height + (height - 1 - y) : (width - 1 - x) * height + y;
+                    memcpy(dst + to * 4, src + (y * width + x) * 4, 4);
+                }
+            }
+        }
+    }
+}
+
+// 180 degrees, in place
+static void rotateHalf(uint8_t *image, int width, int height)
+{
+    uint8_t *front = image;
+    uint8_t *back = image + (width * height - 1) * 4;
+    uint8_t pixel[4];
+    for (; front < back; front += 4, back -= 4)
+    {
+        memcpy(pixel, front, 4);
+        memcpy(front, back, 4);
+        memcpy(back, pixel, 4);
+    }
+}
+
+/* Rotates inputImage clockwise by angle. Right angles keep the buffer and
+ * swap width and height as needed, other angles get a new, larger malloc'ed
+ * buffer and free inputImage if del is set.
+ */
 void OSD::rotateBGRAImage(uint8_t *&inputImage, uint16_t &width, uint16_t &height, int angle, bool del = true)
 {
+    angle %= 360;
+    if (angle < 0)
+        angle += 360;
+
+    switch (angle)
+    {
+    case 0:
+        return;
+    case 180:
+        rotateHalf(inputImage, width, height);
+        return;
+    case 90:
+    case 270:
+        rotateBuffer.resize(width * height * 4);
+        if (angle == 90)
+            rotateRightAngle<true>(rotateBuffer.data(), inputImage, width, height);
+        else
+            rotateRightAngle<false>(rotateBuffer.data(), inputImage, width, height);
+        memcpy(inputImage, rotateBuffer.data(), rotateBuffer.size());
+        std::swap(width, height);
+        return;
+    }
+
     double angleRad = angle * (M_PI / 180.0);
 
     int originalCorners[4][2] = {
@@ -397,7 +490,7 @@ void OSD::rotateBGRAImage(uint8_t *&inputImage, uint16_t &width, uint16_t &heigh
     int newCenterX = newWidth / 2;
     int newCenterY = newHeight / 2;
 
-    auto *rotatedImage = new uint8_t[newWidth * newHeight * 4]();
+    auto *rotatedImage = (uint8_t *)calloc(newWidth * newHeight, 4);
 
     for (int y = 0; y < newHeight; ++y)
     {
@@ -420,7 +513,7 @@ void OSD::rotateBGRAImage(uint8_t *&inputImage, uint16_t &width, uint16_t &heigh
     }
 
     if (del)
-        delete[] inputImage;
+        free(inputImage);
     inputImage = rotatedImage;
     width = newWidth;
     height = newHeight;
@@ -512,7 +605,6 @@ void OSD::init()
 #endif
 
     // cfg = _cfg;
-    last_updated_second = -1;
 
     ret = IMP_Encoder_GetChnAttr(osdGrp, &channelAttributes);
     if (ret < 0)
@@ -557,26 +649,24 @@ void OSD::init()
             cfg->set<int>(getConfigPath("pos_time_y").c_str(), autoOffset, true);
         }
 
-        osdTime.data = nullptr;
-        osdTime.imp_rgn = IMP_OSD_CreateRgn(nullptr);
-        IMP_OSD_RegisterRgn(osdTime.imp_rgn, osdGrp, nullptr);
-        osd.regions.time = osdTime.imp_rgn;
+        // checked every tick, so the time changes right at the second
+        OSDElement &e = addElement(1);
+        osd.regions.time = e.item.imp_rgn;
+        e.update = [this](OSDItem &item)
+        {
+            if (!osd.time_enabled)
+                return;
+
+            time_t now = time(nullptr);
+            struct tm ltime;
+            localtime_r(&now, &ltime);
+            strftime(timeFormatted, sizeof(timeFormatted), osd.time_format, &ltime);
 
-        IMPOSDRgnAttr rgnAttr;
-        memset(&rgnAttr, 0, sizeof(IMPOSDRgnAttr));
-        rgnAttr.type = OSD_REG_PIC;
-        rgnAttr.fmt = PIX_FMT_BGRA;
-        set_text(&osdTime, &rgnAttr, osd.time_format,
-                 osd.pos_time_x, osd.pos_time_y, osd.time_rotation);
-        IMP_OSD_SetRgnAttr(osdTime.imp_rgn, &rgnAttr);
+            set_text(&item, timeFormatted, osd.pos_time_x, osd.pos_time_y, osd.time_rotation);
+        };
 
-        IMPOSDGrpRgnAttr grpRgnAttr;
-        memset(&grpRgnAttr, 0, sizeof(IMPOSDGrpRgnAttr));
-        grpRgnAttr.show = 1;
-        grpRgnAttr.layer = 1;
-        grpRgnAttr.gAlphaEn = 0;
-        grpRgnAttr.fgAlhpa = osd.time_transparency;
-        IMP_OSD_SetGrpRgnAttr(osdTime.imp_rgn, osdGrp, &grpRgnAttr);
+        set_text(&e.item, osd.time_format, osd.pos_time_x, osd.pos_time_y, osd.time_rotation);
+        showElement(e, 1, osd.time_transparency, false);
     }
 
     if (osd.user_text_enabled)
@@ -596,26 +686,46 @@ void OSD::init()
             cfg->set<int>(getConfigPath("pos_user_text_y").c_str(), autoOffset, true);
         }
 
-        osdUser.data = nullptr;
-        osdUser.imp_rgn = IMP_OSD_CreateRgn(nullptr);
-        IMP_OSD_RegisterRgn(osdUser.imp_rgn, osdGrp, nullptr);
-        osd.regions.user = osdUser.imp_rgn;
+        OSDElement &e = addElement(OSD_TICKS_PER_SECOND);
+        osd.regions.user = e.item.imp_rgn;
+        e.update = [this](OSDItem &item)
+        {
+            if (!osd.user_text_enabled)
+                return;
 
-        IMPOSDRgnAttr rgnAttr;
-        memset(&rgnAttr, 0, sizeof(IMPOSDRgnAttr));
-        rgnAttr.type = OSD_REG_PIC;
-        rgnAttr.fmt = PIX_FMT_BGRA;
-        set_text(&osdUser, &rgnAttr, osd.user_text_format,
-                 osd.pos_user_text_x, osd.pos_user_text_y, osd.user_text_rotation);
-        IMP_OSD_SetRgnAttr(osdUser.imp_rgn, &rgnAttr);
+            std::string user_text = osd.user_text_format;
+
+            if (strstr(osd.user_text_format, "%hostname") != nullptr)
+            {
+                replace(user_text, "%hostname", hostname);
+            }
+
+            if (strstr(osd.user_text_format, "%ipaddress") != nullptr)
+            {
+                replace(user_text, "%ipaddress", ip);
+            }
 
-        IMPOSDGrpRgnAttr grpRgnAttr;
-        memset(&grpRgnAttr, 0, sizeof(IMPOSDGrpRgnAttr));
-        grpRgnAttr.show = 1;
-        grpRgnAttr.layer = 2;
-        grpRgnAttr.gAlphaEn = 1;
-        grpRgnAttr.fgAlhpa = osd.user_text_transparency;
-        IMP_OSD_SetGrpRgnAttr(osdUser.imp_rgn, osdGrp, &grpRgnAttr);
+            if (strstr(osd.user_text_format, "%fps") != nullptr)
+            {
+                char fps[4];
+                snprintf(fps, 4, "%3u", osd.stats.fps.load());
+                replace(user_text, "%fps", fps);
+            }
+
+            if (strstr(osd.user_text_format, "%bps") != nullptr)
+            {
+                char bps[8];
+                snprintf(bps, 8, "%5u", osd.stats.bps.load());
+                replace(user_text, "%bps", bps);
+            }
+
+            set_text(&item, user_text.c_str(),
+                     osd.pos_user_text_x, osd.pos_user_text_y, osd.user_text_rotation);
+        };
+
+        set_text(&e.item, osd.user_text_format,
+                 osd.pos_user_text_x, osd.pos_user_text_y, osd.user_text_rotation);
+        showElement(e, 2, osd.user_text_transparency, true);
     }
 
     if (osd.uptime_enabled)
@@ -632,26 +742,26 @@ void OSD::init()
             cfg->set<int>(getConfigPath("pos_uptime_y").c_str(), autoOffset, true);
         }
 
-        osdUptm.data = nullptr;
-        osdUptm.imp_rgn = IMP_OSD_CreateRgn(nullptr);
-        IMP_OSD_RegisterRgn(osdUptm.imp_rgn, osdGrp, nullptr);
-        osd.regions.uptime = osdUptm.imp_rgn;
+        OSDElement &e = addElement(OSD_TICKS_PER_SECOND);
+        osd.regions.uptime = e.item.imp_rgn;
+        e.update = [this](OSDItem &item)
+        {
+            if (!osd.uptime_enabled)
+                return;
+
+            unsigned long currentUptime = getSystemUptime();
+            unsigned long days = currentUptime / 86400;
+            unsigned long hours = (currentUptime % 86400) / 3600;
+            unsigned long minutes = (currentUptime % 3600) / 60;
+            //unsigned long seconds = currentUptime % 60;
 
-        IMPOSDRgnAttr rgnAttr;
-        memset(&rgnAttr, 0, sizeof(IMPOSDRgnAttr));
-        rgnAttr.type = OSD_REG_PIC;
-        rgnAttr.fmt = PIX_FMT_BGRA;
-        set_text(&osdUptm, &rgnAttr, osd.uptime_format,
-                 osd.pos_uptime_x, osd.pos_uptime_y, osd.uptime_rotation);
-        IMP_OSD_SetRgnAttr(osdUptm.imp_rgn, &rgnAttr);
+            snprintf(uptimeFormatted, sizeof(uptimeFormatted), osd.uptime_format, days, hours, minutes);
 
-        IMPOSDGrpRgnAttr grpRgnAttr;
-        memset(&grpRgnAttr, 0, sizeof(IMPOSDGrpRgnAttr));
-        grpRgnAttr.show = 1;
-        grpRgnAttr.layer = 3;
-        grpRgnAttr.gAlphaEn = 1;
-        grpRgnAttr.fgAlhpa = osd.uptime_transparency;
-        IMP_OSD_SetGrpRgnAttr(osdUptm.imp_rgn, osdGrp, &grpRgnAttr);
+            set_text(&item, uptimeFormatted, osd.pos_uptime_x, osd.pos_uptime_y, osd.uptime_rotation);
+        };
+
+        set_text(&e.item, osd.uptime_format, osd.pos_uptime_x, osd.pos_uptime_y, osd.uptime_rotation);
+        showElement(e, 3, osd.uptime_transparency, true);
     }
 
     if (osd.logo_enabled)
@@ -671,50 +781,133 @@ void OSD::init()
         size_t imageSize;
         auto imageData = loadBGRAImage(osd.logo_path, imageSize);
 
-        osdLogo.data = nullptr;
-        osdLogo.imp_rgn = IMP_OSD_CreateRgn(nullptr);
-        IMP_OSD_RegisterRgn(osdLogo.imp_rgn, osdGrp, nullptr);
-        osd.regions.logo = osdLogo.imp_rgn;
-
-        IMPOSDRgnAttr rgnAttr;
-        memset(&rgnAttr, 0, sizeof(IMPOSDRgnAttr));
+        // static, never updated
+        OSDElement &e = addElement(0);
+        osd.regions.logo = e.item.imp_rgn;
 
         // Verify OSD logo size vs dimensions
         if ((osd.logo_width * osd.logo_height * 4) == (int)imageSize)
         {
-            rgnAttr.type = OSD_REG_PIC;
-            rgnAttr.fmt = PIX_FMT_BGRA;
-            rgnAttr.data.picData.pData = imageData;
-
             // Logo rotation
             uint16_t logo_width = osd.logo_width;
             uint16_t logo_height = osd.logo_height;
             if (osd.logo_rotation)
             {
-                uint8_t *imageData = static_cast<uint8_t *>(rgnAttr.data.picData.pData);
                 rotateBGRAImage(imageData, logo_width,
-                                logo_height, osd.logo_rotation, false);
-                rgnAttr.data.picData.pData = imageData;
+                                logo_height, osd.logo_rotation, true);
             }
+            e.item.data = imageData;
 
-            set_pos(&rgnAttr, osd.pos_logo_x,
-                    osd.pos_logo_y, logo_width, logo_height, stream_width, stream_height);
+            set_image(&e.item, logo_width, logo_height, osd.pos_logo_x, osd.pos_logo_y);
         }
         else
         {
 
             LOG_ERROR("Invalid OSD logo dimensions. Imagesize=" << imageSize << ", " << osd.logo_width
                                                                 << "*" << osd.logo_height << "*4=" << (osd.logo_width * osd.logo_height * 4));
+            free(imageData);
+        }
+
+        showElement(e, 4, osd.logo_transparency, true);
+    }
+
+    if (osd.motion_enabled)
+    {
+        /* OSD Motion indicator, below the uptime */
+        if (osd.pos_motion_x == OSD_AUTO_VALUE)
+        {
+            // use cfg->set to set noSave, so auto values will not written to config
+            cfg->set<int>(getConfigPath("pos_motion_x").c_str(), -autoOffset, true);
         }
-        IMP_OSD_SetRgnAttr(osdLogo.imp_rgn, &rgnAttr);
+        if (osd.pos_motion_y == OSD_AUTO_VALUE)
+        {
+            // use cfg->set to set noSave, so auto values will not written to config
+            cfg->set<int>(getConfigPath("pos_motion_y").c_str(), autoOffset * 2 + osd.font_size, true);
+        }
+
+        // a red dot of the font size, shown while motion is detected
+        uint16_t size = std::max(osd.font_size, 4);
+        size += size % 2;
+        float r = size / 2.0f;
+
+        OSDElement &e = addElement(1);
+        e.item.data = (uint8_t *)calloc(size * size, 4);
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                float d = hypotf(x + 0.5f - r, y + 0.5f - r);
+                uint8_t *pixel = e.item.data + (y * size + x) * 4;
+                if (d <= r - 1.5f)
+                {
+                    pixel[2] = 255;
+                    pixel[3] = 255;
+                }
+                else if (d <= r)
+                {
+                    // edge in the stroke color
+                    pixel[0] = (osd.font_stroke_color >> 0) & 0xFF;
+                    pixel[1] = (osd.font_stroke_color >> 8) & 0xFF;
+                    pixel[2] = (osd.font_stroke_color >> 16) & 0xFF;
+                    pixel[3] = 255;
+                }
+            }
+        }
+        set_image(&e.item, size, size, osd.pos_motion_x, osd.pos_motion_y);
+
+        e.update = [this, shown = false](OSDItem &item) mutable
+        {
+            bool motion = osd.motion_enabled && global_motion_indicator;
+            if (motion != shown)
+            {
+                IMP_OSD_ShowRgn(item.imp_rgn, osdGrp, motion);
+                shown = motion;
+            }
+        };
+
+        showElement(e, 5, 255, true, false);
+    }
+
+    if (osd.bitrate_graph_enabled)
+    {
+        /* OSD Bitrate graph, the last minute */
+        if (osd.pos_bitrate_graph_x == OSD_AUTO_VALUE)
+        {
+            // use cfg->set to set noSave, so auto values will not written to config
+            cfg->set<int>(getConfigPath("pos_bitrate_graph_x").c_str(), autoOffset, true);
+        }
+        if (osd.pos_bitrate_graph_y == OSD_AUTO_VALUE)
+        {
+            // use cfg->set to set noSave, so auto values will not written to config
+            cfg->set<int>(getConfigPath("pos_bitrate_graph_y").c_str(), -autoOffset, true);
+        }
+
+        uint16_t height = std::max(osd.font_size, 4);
+        uint16_t width = OSD_GRAPH_SAMPLES * std::max(osd.font_size / 10, 1);
+        height += height % 2;
+
+        OSDElement &e = addElement(OSD_TICKS_PER_SECOND);
+        e.item.data = (uint8_t *)calloc(width * height, 4);
+
+        e.update = [this, width, height, samples = std::vector<uint32_t>(OSD_GRAPH_SAMPLES),
+                    drawn = std::vector<uint32_t>()](OSDItem &item) mutable
+        {
+            if (!osd.bitrate_graph_enabled)
+                return;
 
-        IMPOSDGrpRgnAttr grpRgnAttr;
-        memset(&grpRgnAttr, 0, sizeof(IMPOSDGrpRgnAttr));
-        grpRgnAttr.show = 1;
-        grpRgnAttr.layer = 4;
-        grpRgnAttr.gAlphaEn = 1;
-        grpRgnAttr.fgAlhpa = osd.logo_transparency;
-        IMP_OSD_SetGrpRgnAttr(osdLogo.imp_rgn, osdGrp, &grpRgnAttr);
+            samples.erase(samples.begin());
+            samples.push_back(osd.stats.bps.load());
+            if (samples == drawn)
+                return;
+
+            drawBitrateGraph(item, samples, width, height);
+            set_image(&item, width, height, osd.pos_bitrate_graph_x, osd.pos_bitrate_graph_y);
+            drawn = samples;
+        };
+
+        drawBitrateGraph(e.item, std::vector<uint32_t>(OSD_GRAPH_SAMPLES), width, height);
+        set_image(&e.item, width, height, osd.pos_bitrate_graph_x, osd.pos_bitrate_graph_y);
+        showElement(e, 6, 255, true);
     }
 
     if(osd.start_delay)
@@ -747,137 +940,133 @@ int OSD::exit()
     ret = IMP_OSD_Stop(osdGrp);
     LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_Stop(" << osdGrp << ")");
 
-    ret = IMP_OSD_ShowRgn(osdTime.imp_rgn, osdGrp, 0);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_ShowRgn(osdTime.imp_rgn, " << osdGrp << ", 0)");
-
-    ret = IMP_OSD_ShowRgn(osdUser.imp_rgn, osdGrp, 0);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_ShowRgn(osdUser.imp_rgn, " << osdGrp << ", 0)");
-
-    ret = IMP_OSD_ShowRgn(osdUptm.imp_rgn, osdGrp, 0);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_ShowRgn(osdUptm.imp_rgn, " << osdGrp << ", 0)");
-
-    ret = IMP_OSD_ShowRgn(osdLogo.imp_rgn, osdGrp, 0);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_ShowRgn(osdLogo.imp_rgn, " << osdGrp << ", 0)");
-
-    ret = IMP_OSD_UnRegisterRgn(osdTime.imp_rgn, osdGrp);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_UnRegisterRgn(osdTime.imp_rgn, " << osdGrp << ")");
-
-    ret = IMP_OSD_UnRegisterRgn(osdUser.imp_rgn, osdGrp);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_UnRegisterRgn(osdUser.imp_rgn, " << osdGrp << ")");
+    for (auto &e : elements)
+    {
+        ret = IMP_OSD_ShowRgn(e.item.imp_rgn, osdGrp, 0);
+        LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_ShowRgn(" << e.item.imp_rgn << ", " << osdGrp << ", 0)");
 
-    ret = IMP_OSD_UnRegisterRgn(osdUptm.imp_rgn, osdGrp);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_UnRegisterRgn(osdUptm.imp_rgn, " << osdGrp << ")");
+        ret = IMP_OSD_UnRegisterRgn(e.item.imp_rgn, osdGrp);
+        LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_UnRegisterRgn(" << e.item.imp_rgn << ", " << osdGrp << ")");
 
-    ret = IMP_OSD_UnRegisterRgn(osdLogo.imp_rgn, osdGrp);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_UnRegisterRgn(osdUptm.imp_rgn, " << osdGrp << ")");
+        IMP_OSD_DestroyRgn(e.item.imp_rgn);
 
-    IMP_OSD_DestroyRgn(osdTime.imp_rgn);
-    IMP_OSD_DestroyRgn(osdUser.imp_rgn);
-    IMP_OSD_DestroyRgn(osdUptm.imp_rgn);
-    IMP_OSD_DestroyRgn(osdLogo.imp_rgn);
+        // cleanup osd image data
+        free(e.item.data);
+        schedule(e, false);
+    }
+    elements.clear();
 
     ret = IMP_OSD_DestroyGroup(osdGrp);
     LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_DestroyGroup(" << osdGrp << ")");
 
-    // cleanup osd image data
-    free(osdTime.data);
-    free(osdUser.data);
-    free(osdUptm.data);
-    free(osdLogo.data);
-
-    sft_freefont(sft->font);
+    font.reset();
     return 0;
 }
 
-void OSD::updateDisplayEverySecond()
+/* Elements updating on each tick of a second, over the OSDs of all
+ * streams. A new element takes the least loaded tick of its interval.
+ */
+static std::mutex schedule_mtx;
+static int schedule_load[OSD_TICKS_PER_SECOND];
+
+static int64_t current_tick()
 {
-    gettimeofday(&tm, NULL);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec * 1000000LL + now.tv_nsec / 1000) / THREAD_SLEEP;
+}
 
-    current = time(nullptr);
-    ltime = localtime(&current);
+// the first tick after tick which is phase within interval
+static int64_t next_tick(int64_t tick, int interval, int phase)
+{
+    return tick + 1 + ((phase - tick - 1) % interval + interval) % interval;
+}
 
-    // Check if we have moved to a new second
-    if (ltime->tm_sec != last_updated_second)
-    {
-        flag |= 7;
-        // Update the last second tracker
-        last_updated_second = ltime->tm_sec; 
-    }
-    else
+void OSD::schedule(OSDElement &element, bool add)
+{
+    if (!element.interval)
+        return;
+
+    std::lock_guard lock{schedule_mtx};
+
+    if (add)
     {
-        // The flag ensures that only 1 OSD object is updated
-        // on calling OSD::updateDisplayEverySecond()
-        // this should relieve the system
-        if (flag != 0)
+        element.phase = 0;
+        for (int p = 1; p < element.interval && p < OSD_TICKS_PER_SECOND; ++p)
         {
-            
-            // Format and update system time
-            if ((flag & 1) && osd.time_enabled)
-            {
-                strftime(timeFormatted, sizeof(timeFormatted), osd.time_format, ltime);
-
-                set_text(&osdTime, nullptr, timeFormatted,
-                         osd.pos_time_x, osd.pos_time_y, osd.time_rotation);
+            if (schedule_load[p] < schedule_load[element.phase])
+                element.phase = p;
+        }
+        element.due = next_tick(current_tick(), element.interval, element.phase);
+    }
 
-                flag ^= 1;
-                return;
-            }
+    for (int t = element.phase % OSD_TICKS_PER_SECOND; t < OSD_TICKS_PER_SECOND; t += element.interval)
+    {
+        schedule_load[t] += add ? 1 : -1;
+    }
+}
 
-            // Format and update user text
-            if ((flag & 2) && osd.user_text_enabled)
-            {
-                std::string user_text = osd.user_text_format;
+// A region for a new element, updated every interval ticks, or never for 0
+OSDElement &OSD::addElement(int interval)
+{
+    OSDElement &e = elements.emplace_back();
 
-                if (strstr(osd.user_text_format, "%hostname") != nullptr)
-                {
-                    replace(user_text, "%hostname", hostname);
-                }
+    e.item.data = nullptr;
+    e.item.imp_rgn = IMP_OSD_CreateRgn(nullptr);
+    IMP_OSD_RegisterRgn(e.item.imp_rgn, osdGrp, nullptr);
 
-                if (strstr(osd.user_text_format, "%ipaddress") != nullptr)
-                {
-                    replace(user_text, "%ipaddress", ip);
-                }
+    e.item.rgnAttr.type = OSD_REG_PIC;
+    e.item.rgnAttr.fmt = PIX_FMT_BGRA;
 
-                if (strstr(osd.user_text_format, "%fps") != nullptr)
-                {
-                    char fps[4];
-                    snprintf(fps, 4, "%3d", osd.stats.fps);
-                    replace(user_text, "%fps", fps);
-                }
+    e.interval = interval;
+    schedule(e, true);
 
-                if (strstr(osd.user_text_format, "%bps") != nullptr)
-                {
-                    char bps[8];
-                    snprintf(bps, 8, "%5d", osd.stats.bps);
-                    replace(user_text, "%bps", bps);
-                }
+    return e;
+}
 
-                set_text(&osdUser, nullptr, user_text.c_str(),
-                         osd.pos_user_text_x, osd.pos_user_text_y, osd.user_text_rotation);
+void OSD::showElement(OSDElement &element, int layer, int transparency, bool globalAlpha, bool show)
+{
+    IMPOSDGrpRgnAttr grpRgnAttr;
+    memset(&grpRgnAttr, 0, sizeof(IMPOSDGrpRgnAttr));
+    grpRgnAttr.show = show;
+    grpRgnAttr.layer = layer;
+    grpRgnAttr.gAlphaEn = globalAlpha;
+    grpRgnAttr.fgAlhpa = transparency;
+    IMP_OSD_SetGrpRgnAttr(element.item.imp_rgn, osdGrp, &grpRgnAttr);
+}
 
-                user_text.clear();
+// Bars of the samples in the font color on a translucent stroke colored background
+void OSD::drawBitrateGraph(OSDItem &item, const std::vector<uint32_t> &samples, uint16_t width, uint16_t height)
+{
+    uint32_t max = *std::max_element(samples.begin(), samples.end());
+    int barWidth = width / samples.size();
 
-                flag ^= 2;
-                return;
-            }
+    uint8_t background[4] = {(uint8_t)(osd.font_stroke_color >> 0), (uint8_t)(osd.font_stroke_color >> 8),
+                             (uint8_t)(osd.font_stroke_color >> 16), 96};
+    uint8_t bar[4] = {(uint8_t)(osd.font_color >> 0), (uint8_t)(osd.font_color >> 8),
+                      (uint8_t)(osd.font_color >> 16), 255};
 
-            // Format and update uptime
-            if ((flag & 4) && osd.uptime_enabled)
-            {
-                unsigned long currentUptime = getSystemUptime();
-                unsigned long days = currentUptime / 86400;
-                unsigned long hours = (currentUptime % 86400) / 3600;
-                unsigned long minutes = (currentUptime % 3600) / 60;
-                //unsigned long seconds = currentUptime % 60;
+    for (int x = 0; x < width; ++x)
+    {
+        size_t i = x / barWidth;
+        int top = height - (max && i < samples.size() ? (int)((uint64_t)samples[i] * height / max) : 0);
+        for (int y = 0; y < height; ++y)
+        {
+            memcpy(item.data + (y * width + x) * 4, y < top ? background : bar, 4);
+        }
+    }
+}
 
-                snprintf(uptimeFormatted, sizeof(uptimeFormatted), osd.uptime_format, days, hours, minutes);
+void OSD::update()
+{
+    int64_t tick = current_tick();
 
-                set_text(&osdUptm, nullptr, uptimeFormatted,
-                         osd.pos_uptime_x, osd.pos_uptime_y, osd.uptime_rotation);
+    for (auto &e : elements)
+    {
+        if (!e.interval || tick < e.due)
+            continue;
 
-                flag ^= 4;
-                return;
-            }          
-        }
+        e.update(e.item);
+        e.due = next_tick(tick, e.interval, e.phase);
     }
 }
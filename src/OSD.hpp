@@ -3,6 +3,8 @@
 
 //#include <map>
 #include <memory>
+#include <functional>
+#include <vector>
 #include "Config.hpp"
 #include <imp/imp_osd.h>
 #include <imp/imp_encoder.h>
@@ -10,7 +12,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/sysinfo.h>
-#include "schrift.h"
+#include "FontCache.hpp"
 
 #if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
 #define IMPEncoderCHNAttr IMPEncoderChnAttr
@@ -23,17 +25,28 @@ struct OSDItem
     uint8_t *data;
     uint16_t width;
     uint16_t height;
-    IMPOSDRgnAttrData *rgnAttrData;
+    IMPOSDRgnAttr rgnAttr; // as last set, picData points to data
+    std::string text; // text in data, to redraw only what changed
 };
 
-struct Glyph {
-    int width;
-    int height;
-    std::vector<uint8_t> bitmap;
-    int advance;
-    int xmin;
-    int ymin;
-    SFT_Glyph glyph;
+// OSD updates per second, Worker::update_osd runs every THREAD_SLEEP
+#define OSD_TICKS_PER_SECOND (1000000 / THREAD_SLEEP)
+
+// seconds shown by the bitrate graph
+#define OSD_GRAPH_SAMPLES 60
+
+/* A region of the OSD with its own update interval. update is called on
+ * the ticks the element is due and redraws the region only if what it
+ * shows changed. Elements are spread over the ticks of their interval,
+ * across the OSDs of all streams, so the work doesn't pile up on one tick.
+ */
+struct OSDElement
+{
+    OSDItem item{};
+    int interval{0}; // ticks between updates, 0 for static content
+    int phase{0};    // tick within the interval it updates on
+    int64_t due{0};  // next tick to update on
+    std::function<void(OSDItem &)> update;
 };
 
 class OSD
@@ -48,7 +61,8 @@ public:
     int exit();
     int start();
 
-    void updateDisplayEverySecond();
+    // called every THREAD_SLEEP, updates the elements which are due
+    void update();
 
     void rotateBGRAImage(uint8_t *&inputImage, uint16_t &width, uint16_t &height, int angle, bool del);
     static void set_pos(IMPOSDRgnAttr *rgnAttr, int x, int y, uint16_t width, uint16_t height, const uint16_t max_width, const uint16_t max_height);
@@ -60,27 +74,30 @@ private:
 
     // libschrift
     //std::vector<uint8_t> fontData;
-    std::unordered_map<char, Glyph> glyphs;
-    SFT *sft;
+    std::shared_ptr<Font> font;
     int load_font();
     int libschrift_init();
-    int renderGlyph(const char* characters);
-    void drawOutline(uint8_t* image, const Glyph& g, int x, int y, int outlineSize, int WIDTH, int HEIGHT);
+    int glyphAdvance(char c, const Glyph& g);
     int calculateTextSize(const char* text, uint16_t& width, uint16_t& height, int outlineSize);
-    int drawText(uint8_t* image, const char* text, int WIDTH, int HEIGHT, int outlineSize);
-    uint8_t BGRA_STROKE[4];
-    uint8_t BGRA_TEXT[4];
+    bool textDamage(const char* from, const char* to, int outlineSize, int WIDTH, int& x0, int& x1);
+    int drawText(uint8_t* image, const char* text, int WIDTH, int HEIGHT, int outlineSize, int clipX0 = 0, int clipX1 = -1);
+
+    // alpha planes of the text being drawn, reused
+    std::vector<uint8_t> textPlane;
+    std::vector<uint8_t> strokePlane;
+    // scratch image of right angle rotations, reused
+    std::vector<uint8_t> rotateBuffer;
 
     _osd &osd;
-    int last_updated_second;
-    
 
-    OSDItem osdTime{};
-    OSDItem osdUser{};
-    OSDItem osdUptm{};
-    OSDItem osdLogo{};
+    std::vector<OSDElement> elements;
+    OSDElement &addElement(int interval);
+    void showElement(OSDElement &element, int layer, int transparency, bool globalAlpha, bool show = true);
+    void schedule(OSDElement &element, bool add);
 
-    void set_text(OSDItem *osdItem, IMPOSDRgnAttr *rgnAttr, const char *text, int posX, int posY, int angle);
+    void set_text(OSDItem *osdItem, const char *text, int posX, int posY, int angle);
+    void set_image(OSDItem *osdItem, uint16_t width, uint16_t height, int posX, int posY);
+    void drawBitrateGraph(OSDItem &item, const std::vector<uint32_t> &samples, uint16_t width, uint16_t height);
     std::string getConfigPath(const char *itemName);
 
     IMPEncoderCHNAttr channelAttributes;
@@ -96,15 +113,8 @@ private:
     uint16_t stream_width;
     uint16_t stream_height;
 
-    time_t current;
-    struct tm *ltime;
-    struct timeval tm;
-
     char timeFormatted[32];
     char uptimeFormatted[32];
-    char fps[4];
-    char bps[8];
-    uint8_t flag{0};
 };
 
 #endif
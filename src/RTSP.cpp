@@ -1,4 +1,8 @@
 #include "RTSP.hpp"
+#include "GroupsockHelper.hh"
+#include "BatchedGroupsock.hpp"
+#include <arpa/inet.h>
+#include <unistd.h>
 
 #define MODULE "RTSP"
 
@@ -6,7 +10,13 @@ void RTSP::addSubsession(int chnNr, _stream &stream)
 {
 
     LOG_DEBUG("identify stream " << chnNr);
-    auto deviceSource = IMPDeviceSource<H264NALUnit,video_stream>::createNew(*env, chnNr, global_video[chnNr], "video/pps/sps/vps");
+    // subscribe a reader of our own, it starts with the next keyframe
+    auto reader = global_video[chnNr]->msgChannel->subscribe(nullptr);
+    {
+        std::lock_guard lock_stream {global_video[chnNr]->mtx};
+        global_video[chnNr]->hasDataCallback = true;
+        global_video[chnNr]->should_grab_frames.notify_one();
+    }
     H264NALUnit sps;
     H264NALUnit pps;
     H264NALUnit *vps = nullptr;
@@ -17,7 +27,7 @@ void RTSP::addSubsession(int chnNr, _stream &stream)
     // Read from the stream until we capture the SPS and PPS. Only capture VPS if needed.
     while (!have_pps || !have_sps || (is_h265 && !have_vps))
     {
-        H264NALUnit unit = global_video[chnNr]->msgChannel->wait_read();
+        H264NALUnit unit = global_video[chnNr]->msgChannel->wait_read(*reader);
         if (is_h265)
         {
             uint8_t nalType = (unit.data[0] & 0x7E) >> 1; // H265 NAL unit type extraction
@@ -25,19 +35,24 @@ void RTSP::addSubsession(int chnNr, _stream &stream)
             { // SPS for H265
                 LOG_DEBUG("Got SPS (H265)");
                 sps = unit;
+                sps.data = unit.data.clone();
                 have_sps = true;
             }
             else if (nalType == 34)
             { // PPS for H265
                 LOG_DEBUG("Got PPS (H265)");
                 pps = unit;
+                pps.data = unit.data.clone();
                 have_pps = true;
             }
             else if (nalType == 32)
             { // VPS, only for H265
                 LOG_DEBUG("Got VPS");
                 if (!vps)
+                {
                     vps = new H264NALUnit(unit); // Allocate and store VPS
+                    vps->data = unit.data.clone();
+                }
                 have_vps = true;
             }
         }
@@ -48,19 +63,24 @@ void RTSP::addSubsession(int chnNr, _stream &stream)
             { // SPS for H264
                 LOG_DEBUG("Got SPS (H264)");
                 sps = unit;
+                sps.data = unit.data.clone();
                 have_sps = true;
             }
             else if (nalType == 8)
             { // PPS for H264
                 LOG_DEBUG("Got PPS (H264)");
                 pps = unit;
+                pps.data = unit.data.clone();
                 have_pps = true;
             }
             // No VPS in H264, so no need to check for it
         }
     }
-    //deviceSource->deinit();
-    delete deviceSource;
+    {
+        std::lock_guard lock_stream {global_video[chnNr]->mtx};
+        global_video[chnNr]->msgChannel->unsubscribe(reader);
+        global_video[chnNr]->hasDataCallback = global_video[chnNr]->msgChannel->reader_count() > 0;
+    }
     LOG_DEBUG("Got necessary NAL Units.");
 
     ServerMediaSession *sms = ServerMediaSession::createNew(
@@ -83,6 +103,82 @@ void RTSP::addSubsession(int chnNr, _stream &stream)
 
     char *url = rtspServer->rtspURL(sms);
     LOG_INFO("stream " << chnNr << " available at: " << url);
+
+    if (cfg->rtsp.multicast)
+    {
+        addMulticastSession(chnNr, stream, (is_h265 ? vps : nullptr), sps, pps);
+    }
+}
+
+/* The multicast session has a single source and RTP sink, every frame is
+ * packetized and sent once, no matter how many viewers joined the group.
+ * RTSP is only used to hand out the SDP, the stream is sent continuously.
+ */
+void RTSP::addMulticastSession(int chnNr, _stream &stream, H264NALUnit *vps, H264NALUnit &sps, H264NALUnit &pps)
+{
+    struct sockaddr_storage groupAddress;
+    memset(&groupAddress, 0, sizeof(groupAddress));
+    groupAddress.ss_family = AF_INET;
+    struct in_addr &addr = ((struct sockaddr_in &)groupAddress).sin_addr;
+    if (strlen(cfg->rtsp.multicast_address) == 0 ||
+        inet_pton(AF_INET, cfg->rtsp.multicast_address, &addr) != 1)
+    {
+        addr.s_addr = chooseRandomIPv4SSMAddress(*env);
+    }
+
+    const Port rtpPort(cfg->rtsp.multicast_port + 2 * chnNr);
+    const Port rtcpPort(cfg->rtsp.multicast_port + 2 * chnNr + 1);
+
+    MulticastSession mc;
+    if (cfg->rtsp.batch_send)
+        mc.rtpGroupsock = new BatchedGroupsock(*env, groupAddress, rtpPort, cfg->rtsp.multicast_ttl);
+    else
+        mc.rtpGroupsock = new Groupsock(*env, groupAddress, rtpPort, cfg->rtsp.multicast_ttl);
+    mc.rtcpGroupsock = new Groupsock(*env, groupAddress, rtcpPort, cfg->rtsp.multicast_ttl);
+    mc.rtpGroupsock->multicastSendOnly();
+    mc.rtcpGroupsock->multicastSendOnly();
+    increaseSendBufferTo(*env, mc.rtpGroupsock->socketNum(), cfg->rtsp.send_buffer_size);
+
+    auto imp = IMPDeviceSource<H264NALUnit, video_stream>::createNew(*env, chnNr, global_video[chnNr], "multicast");
+    if (vps)
+    {
+        mc.source = H265VideoStreamDiscreteFramer::createNew(*env, imp, false, false);
+        mc.sink = H265VideoRTPSink::createNew(
+            *env, mc.rtpGroupsock, 96,
+            vps->data.data(), vps->data.size(),
+            sps.data.data(), sps.data.size(),
+            pps.data.data(), pps.data.size());
+    }
+    else
+    {
+        mc.source = H264VideoStreamDiscreteFramer::createNew(*env, imp, false, false);
+        mc.sink = H264VideoRTPSink::createNew(
+            *env, mc.rtpGroupsock, 96,
+            sps.data.data(), sps.data.size(),
+            pps.data.data(), pps.data.size());
+    }
+
+    unsigned char cname[101];
+    memset(cname, 0, sizeof(cname));
+    gethostname((char *)cname, sizeof(cname) - 1);
+    mc.rtcp = RTCPInstance::createNew(*env, mc.rtcpGroupsock, stream.bitrate, cname,
+                                      mc.sink, nullptr, cfg->rtsp.multicast_ssm);
+
+    std::string endpoint = std::string(stream.rtsp_endpoint) + "_multicast";
+    ServerMediaSession *sms = ServerMediaSession::createNew(
+        *env, endpoint.c_str(), stream.rtsp_info, cfg->rtsp.name, cfg->rtsp.multicast_ssm);
+    sms->addSubsession(PassiveServerMediaSubsession::createNew(*mc.sink, mc.rtcp));
+    rtspServer->addServerMediaSession(sms);
+
+    mc.sink->startPlaying(*mc.source, nullptr, nullptr);
+    multicastSessions.push_back(mc);
+
+    char groupStr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr, groupStr, sizeof(groupStr));
+    char *url = rtspServer->rtspURL(sms);
+    LOG_INFO("stream " << chnNr << " multicast " << (cfg->rtsp.multicast_ssm ? "(SSM) " : "(ASM) ") <<
+             groupStr << ":" << rtpPort.num() << " available at: " << url);
+    delete[] url;
 }
 
 void RTSP::start()
@@ -161,6 +257,17 @@ void RTSP::start()
 
     // Cleanup RTSP server and environment
     Medium::close(rtspServer);
+
+    for (auto &mc : multicastSessions)
+    {
+        mc.sink->stopPlaying();
+        Medium::close(mc.source);
+        Medium::close(mc.rtcp);
+        Medium::close(mc.sink);
+        delete mc.rtcpGroupsock;
+        delete mc.rtpGroupsock;
+    }
+    multicastSessions.clear();
     env->reclaim();
     delete scheduler;
 }
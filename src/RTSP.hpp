@@ -1,6 +1,7 @@
 #ifndef RTSP_hpp
 #define RTSP_hpp
 
+#include <vector>
 #include "liveMedia.hh"
 #include "BasicUsageEnvironment.hh"
 #include "IMPServerMediaSubsession.hpp"
@@ -14,6 +15,7 @@ class RTSP
 public:
     RTSP(){};
     void addSubsession(int chnNr, _stream &stream);
+    void addMulticastSession(int chnNr, _stream &stream, H264NALUnit *vps, H264NALUnit &sps, H264NALUnit &pps);
     void start();
     static void *run(void* arg);
     
@@ -23,6 +25,17 @@ private:
     RTSPServer *rtspServer{};
     int audioChn = 0;
     IMPDeviceSource<AudioFrame, audio_stream> * audioSource = nullptr;
+
+    // one RTP sink per multicast stream, shared by all viewers
+    struct MulticastSession
+    {
+        Groupsock *rtpGroupsock;
+        Groupsock *rtcpGroupsock;
+        FramedSource *source;
+        RTPSink *sink;
+        RTCPInstance *rtcp;
+    };
+    std::vector<MulticastSession> multicastSessions;
 };
 
 #endif
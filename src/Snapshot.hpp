@@ -0,0 +1,94 @@
+#ifndef Snapshot_hpp
+#define Snapshot_hpp
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/* Latest JPEG of a jpeg channel, kept in memory.
+ * Double buffered: the grabber fills the back buffer and publishes it as
+ * the new front. Readers take a reference to the front and send it
+ * without copying, a buffer still referenced by a reader is not reused.
+ * Every published image gets the next generation number, so readers can
+ * tell whether there is a new image since they last looked.
+ *
+ * Each image is preceded by headroom bytes, so protocol headers can be
+ * put in front of the payload without copying it (LWS_PRE, multipart).
+ */
+class Snapshot
+{
+public:
+    static constexpr size_t headroom = 256;
+
+    struct Image
+    {
+        std::vector<uint8_t> buf;
+        size_t len{0};
+        uint32_t generation{0};
+
+        const uint8_t *data() const { return buf.data() + headroom; }
+        uint8_t *data() { return buf.data() + headroom; }
+        size_t size() const { return len; }
+    };
+
+    // buffer for the next image with room for size bytes
+    std::shared_ptr<Image> prepare(size_t size)
+    {
+        std::shared_ptr<Image> img;
+        {
+            std::lock_guard lock(mtx);
+            img = std::move(back);
+        }
+        if (!img || img.use_count() != 1)
+            img = std::make_shared<Image>();
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        img->buf.resize(headroom + size);
+        img->len = size;
+        return img;
+    }
+
+    void publish(std::shared_ptr<Image> img)
+    {
+        std::function<void(void)> notify;
+        {
+            std::lock_guard lock(mtx);
+            img->generation = gen.load(std::memory_order_relaxed) + 1;
+            back = std::move(front);
+            front = std::move(img);
+            gen.store(front->generation, std::memory_order_release);
+            notify = listener;
+        }
+        if (notify)
+            notify();
+    }
+
+    // called from the grabber thread after every publish
+    void set_listener(std::function<void(void)> fn)
+    {
+        std::lock_guard lock(mtx);
+        listener = std::move(fn);
+    }
+
+    // latest image, nullptr until the first one was published
+    std::shared_ptr<const Image> get()
+    {
+        std::lock_guard lock(mtx);
+        return front;
+    }
+
+    uint32_t generation() const { return gen.load(std::memory_order_acquire); }
+
+private:
+    std::mutex mtx;
+    std::shared_ptr<Image> front;
+    std::shared_ptr<Image> back;
+    std::atomic<uint32_t> gen{0};
+    std::function<void(void)> listener;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "Tracer.hpp"
+#include <map>
+#include <tuple>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+#include <time.h>
+
+Tracer &Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::enable(bool enable)
+{
+    if (enable && !enabled())
+    {
+        // nothing is recorded while disabled, except stamps still in flight
+        for (auto &slot : slots)
+            slot.seq.store(0, std::memory_order_relaxed);
+        head.store(0, std::memory_order_relaxed);
+    }
+    on.store(enable, std::memory_order_release);
+}
+
+int64_t Tracer::now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+void Tracer::record(Stage stage, int stream, uint32_t session, int64_t imp_ts, int64_t ts)
+{
+    uint32_t n = head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = slots[n % TRACE_EVENTS];
+
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.ev.ts = ts;
+    slot.ev.imp_ts = imp_ts;
+    slot.ev.session = session;
+    slot.ev.stage = stage;
+    slot.ev.stream = stream;
+    slot.seq.store(n + 1, std::memory_order_release);
+}
+
+/* Every stage becomes a complete event ("X") lasting from the previous
+ * stamp of the access unit: encode (capture to GetStream), channel
+ * (GetStream to written), queue (written to dequeued by the session) and
+ * send. Streams are shown as processes, the encoder side as thread 0 and
+ * the sessions as threads with their session id. Stages whose previous
+ * stamp was already overwritten are left out.
+ */
+std::string Tracer::dump()
+{
+    static const char *const names[] = {"encode", "channel", "queue", "send"};
+
+    std::vector<Event> events;
+    events.reserve(TRACE_EVENTS);
+    for (auto &slot : slots)
+    {
+        uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == 0)
+            continue;
+        Event ev = slot.ev;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq)
+            events.push_back(ev);
+    }
+    std::sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.ts < b.ts; });
+
+    // stamp of the previous stage: stream, session, access unit, stage
+    std::map<std::tuple<int, uint32_t, int64_t, int>, int64_t> stamps;
+    for (auto &ev : events)
+        stamps[{ev.stream, ev.session, ev.imp_ts, ev.stage}] = ev.ts;
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    char buf[256];
+    bool first = true;
+    std::map<std::pair<int, uint32_t>, bool> threads; // sorted by stream
+
+    for (auto &ev : events)
+    {
+        int64_t start;
+        if (ev.stage == GET_STREAM)
+        {
+            start = ev.imp_ts;
+        }
+        else
+        {
+            // the encoder side stamps have no session
+            uint32_t session = ev.stage == DELIVER ? 0 : ev.session;
+            auto prev = stamps.find({ev.stream, session, ev.imp_ts, ev.stage - 1});
+            if (prev == stamps.end())
+                continue;
+            start = prev->second;
+        }
+
+        snprintf(buf, sizeof(buf), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%lld,\"dur\":%lld,"
+                 "\"args\":{\"imp_ts\":%lld}}",
+                 first ? "" : ",", names[ev.stage], ev.stream, ev.session, (long long)start,
+                 (long long)(ev.ts - start), (long long)ev.imp_ts);
+        json += buf;
+        first = false;
+        threads[{ev.stream, ev.session}] = true;
+    }
+
+    // names shown for the pids and tids
+    int lastStream = -1;
+    for (auto &t : threads)
+    {
+        int stream = t.first.first;
+        uint32_t session = t.first.second;
+        if (stream != lastStream)
+        {
+            snprintf(buf, sizeof(buf), "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"stream%d\"}}",
+                     first ? "" : ",", stream, stream);
+            json += buf;
+            first = false;
+            lastStream = stream;
+        }
+        if (session)
+            snprintf(buf, sizeof(buf), ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"session %u\"}}",
+                     stream, session, session);
+        else
+            snprintf(buf, sizeof(buf), ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"encoder\"}}",
+                     stream);
+        json += buf;
+    }
+
+    json += "]}";
+    return json;
+}
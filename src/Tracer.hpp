@@ -0,0 +1,78 @@
+#ifndef Tracer_hpp
+#define Tracer_hpp
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+// events kept by the tracer, the oldest are overwritten
+#define TRACE_EVENTS 4096
+
+/* Latency trace of the video pipeline, enabled with general.latency_trace.
+ * Every access unit is stamped when IMP_Encoder_GetStream returns it, when
+ * it is in the broadcast channel, and per RTSP session when deliverFrame
+ * dequeues it and when the RTP sink has sent it. The access unit is
+ * identified by its encoder timestamp, all stamps are CLOCK_MONOTONIC µs
+ * like the encoder timestamp.
+ *
+ * Writers claim a slot of the ring with one atomic add, a sequence number
+ * per slot lets dump() skip slots which are overwritten meanwhile.
+ */
+class Tracer
+{
+public:
+    enum Stage : uint8_t
+    {
+        GET_STREAM,
+        CHANNEL_WRITE,
+        DELIVER,
+        SENT
+    };
+
+    static Tracer &instance();
+
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+
+    // enabling starts a new trace
+    void enable(bool enable);
+
+    /* session is 0 for the encoder side stages,
+     * ts is the time of the stamp, 0 for now
+     */
+    void stamp(Stage stage, int stream, uint32_t session, int64_t imp_ts, int64_t ts = 0)
+    {
+        if (enabled() && imp_ts > 0)
+            record(stage, stream, session, imp_ts, ts ? ts : now());
+    }
+
+    // CLOCK_MONOTONIC in µs
+    static int64_t now();
+
+    // the recorded access units in Chrome trace event format (chrome://tracing, Perfetto)
+    std::string dump();
+
+private:
+    struct Event
+    {
+        int64_t ts;
+        int64_t imp_ts;
+        uint32_t session;
+        uint8_t stage;
+        uint8_t stream;
+    };
+
+    struct Slot
+    {
+        std::atomic<uint32_t> seq{0}; // 0 while written, else the event number + 1
+        Event ev;
+    };
+
+    Tracer() = default;
+    void record(Stage stage, int stream, uint32_t session, int64_t imp_ts, int64_t ts);
+
+    Slot slots[TRACE_EVENTS];
+    std::atomic<uint32_t> head{0};
+    std::atomic<bool> on{false};
+};
+
+#endif
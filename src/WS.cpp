@@ -4,6 +4,7 @@
 #include <fstream>
 #include <memory>
 #include <variant>
+#include <algorithm>
 #include "Config.hpp"
 #include "libwebsockets.h"
 #include <imp/imp_osd.h>
@@ -12,6 +13,7 @@
 #include "OSD.hpp"
 #include "worker.hpp"
 #include "globals.hpp"
+#include "Tracer.hpp"
 #include <filesystem>
 #include <sys/inotify.h>
 
@@ -73,7 +75,11 @@ enum
     PNT_FLAG_HTTP_SEND_MESSAGE = 4096,
     PNT_FLAG_HTTP_RECEIVED_MESSAGE = 8192,
     PNT_FLAG_HTTP_SEND_PREVIEW = 16384,
-    PNT_FLAG_HTTP_SEND_INVALID = 32768
+    PNT_FLAG_HTTP_SEND_INVALID = 32768,
+    PNT_FLAG_HTTP_SEND_MJPEG = 65536,
+    PNT_FLAG_HTTP_MJPEG_STREAM = 131072,
+    PNT_FLAG_HTTP_SEND_METRICS = 262144,
+    PNT_FLAG_HTTP_SEND_TRACE = 524288
 };
 
 /* ROOT */
@@ -87,6 +93,7 @@ enum
     PNT_STREAM0,
     PNT_STREAM1,
     PNT_STREAM2,
+    PNT_STREAM3,
     PNT_MOTION,
     PNT_INFO,
     PNT_ACTION
@@ -101,6 +108,7 @@ static const char *const root_keys[] = {
     "stream0",
     "stream1",
     "stream2",
+    "stream3",
     "motion",
     "info",
     "action"};
@@ -110,13 +118,15 @@ enum
 {
     PNT_GENERAL_LOGLEVEL = 1,
     PNT_GENERAL_OSD_POOL_SIZE,
-    PNT_GENERAL_IMP_POLLING_TIMEOUT
+    PNT_GENERAL_IMP_POLLING_TIMEOUT,
+    PNT_GENERAL_LATENCY_TRACE
 };
 
 static const char *const general_keys[] = {
     "loglevel",
     "osd_pool_size",
-    "imp_polling_timeout"};
+    "imp_polling_timeout",
+    "latency_trace"};
 
 /* RTSP */
 enum
@@ -125,10 +135,20 @@ enum
     PNT_RTSP_EST_BITRATE,
     PNT_RTSP_OUT_BUFFER_SIZE,
     PNT_RTSP_SEND_BUFFER_SIZE,
+    PNT_RTSP_PACING_RATE,
+    PNT_RTSP_GOP_CACHE_SIZE,
+    PNT_RTSP_TCP_QUEUE_LIMIT,
+    PNT_RTSP_MULTICAST_PORT,
+    PNT_RTSP_MULTICAST_TTL,
     PNT_RTSP_AUTH_REQUIRED,
+    PNT_RTSP_MULTICAST,
+    PNT_RTSP_MULTICAST_SSM,
+    PNT_RTSP_SHARED_PACKETIZATION,
+    PNT_RTSP_BATCH_SEND,
     PNT_RTSP_NAME,
     PNT_RTSP_USERNAME,
-    PNT_RTSP_PASSWORD
+    PNT_RTSP_PASSWORD,
+    PNT_RTSP_MULTICAST_ADDRESS
 };
 
 static const char *const rtsp_keys[] = {
@@ -136,10 +156,20 @@ static const char *const rtsp_keys[] = {
     "est_bitrate",
     "out_buffer_size",
     "send_buffer_size",
+    "pacing_rate",
+    "gop_cache_size",
+    "tcp_queue_limit",
+    "multicast_port",
+    "multicast_ttl",
     "auth_required",
+    "multicast",
+    "multicast_ssm",
+    "shared_packetization",
+    "batch_send",
     "name",
     "username",
-    "password"};
+    "password",
+    "multicast_address"};
 
 /* SENSOR */
 enum
@@ -289,7 +319,7 @@ static const char *const stream_keys[] = {
     "stats",
     "osd"};
 
-/* STREAM2 (JPEG) */
+/* STREAM2 / STREAM3 (JPEG) */
 enum
 {
     PNT_STREAM2_JPEG_ENABLED = 1,
@@ -298,7 +328,8 @@ enum
     //PNT_STREAM2_JPEG_REFRESH,
     PNT_STREAM2_JPEG_CHANNEL,
     PNT_STREAM2_STATS,
-    PNT_STREAM2_FPS
+    PNT_STREAM2_FPS,
+    PNT_STREAM2_JPEG_SAVE_INTERVAL
 };
 
 static const char *const stream2_keys[] = {
@@ -308,7 +339,8 @@ static const char *const stream2_keys[] = {
     //"jpeg_refresh",
     "jpeg_channel",
     "stats",
-    "fps"};
+    "fps",
+    "jpeg_save_interval"};
 
 /* OSD */
 enum
@@ -331,6 +363,10 @@ enum
     PNT_OSD_POS_UPTIME_X,
     PNT_OSD_POS_UPTIME_Y,
     PNT_OSD_UPTIME_ROTATION,
+    PNT_OSD_POS_MOTION_X,
+    PNT_OSD_POS_MOTION_Y,
+    PNT_OSD_POS_BITRATE_GRAPH_X,
+    PNT_OSD_POS_BITRATE_GRAPH_Y,
 
     PNT_OSD_POS_LOGO_X,
     PNT_OSD_POS_LOGO_Y,
@@ -341,6 +377,8 @@ enum
     PNT_OSD_USER_TEXT_ENABLED,
     PNT_OSD_UPTIME_ENABLED,
     PNT_OSD_LOGO_ENABLED,
+    PNT_OSD_MOTION_ENABLED,
+    PNT_OSD_BITRATE_GRAPH_ENABLED,
 
     PNT_OSD_FONT_PATH,
     PNT_OSD_TIME_FORMAT,
@@ -370,6 +408,10 @@ static const char *const osd_keys[] = {
     "pos_uptime_x",
     "pos_uptime_y",
     "uptime_rotation",
+    "pos_motion_x",
+    "pos_motion_y",
+    "pos_bitrate_graph_x",
+    "pos_bitrate_graph_y",
 
     "pos_logo_x",
     "pos_logo_y",
@@ -380,6 +422,8 @@ static const char *const osd_keys[] = {
     "user_text_enabled",
     "uptime_enabled",
     "logo_enabled",
+    "motion_enabled",
+    "bitrate_graph_enabled",
     "font_path",
     "time_format",
     "uptime_format",
@@ -435,11 +479,17 @@ static const char *const motion_keys[] = {
 /* INFO */
 enum
 {
-    PNT_INFO_IMP_SYSTEM_VERSION = 1
+    PNT_INFO_IMP_SYSTEM_VERSION = 1,
+    PNT_INFO_BUFFER_POOL,
+    PNT_INFO_ENCODER_STATS,
+    PNT_INFO_METRICS
 };
 
 static const char *const info_keys[] = {
-    "imp_system_version"};
+    "imp_system_version",
+    "buffer_pool",
+    "encoder_stats",
+    "metrics"};
 
 /* ACTION */
 enum
@@ -470,6 +520,9 @@ struct snapshot_info
     int r;             // current requests
     int rps;           // requests per second
     int throttle = 50; // throttle value to set a variable request delay time
+    uint32_t generation; // generation of the last image sent
+    int stale;           // times the send was postponed waiting for a new image
+    int channel;         // jpeg channel the images are taken from
     steady_clock::time_point last_snapshot_request;
 };
 
@@ -522,10 +575,32 @@ const char* generateToken(int length)
     return tokenBuffer;
 }
 
+// time to parse a json request of a WS or http client and build the response
+static Metrics::Histogram &request_time = Metrics::instance().histogram(
+    "prudynt_ws_request_seconds", "Time to handle a WS or /json request.");
+
+/* Config changes which the running encoders applied without restart.
+ * A requested video restart is skipped if they are the only changes
+ * since the last one. Only used by the lws service thread.
+ */
+static unsigned int restart_changes = 0; // cfg->changes at the last video restart
+static unsigned int live_changes = 0;
+
+static bool video_restart_required()
+{
+    return live_changes == 0 || cfg->changes - restart_changes != live_changes;
+}
+
+static void video_restart_done()
+{
+    restart_changes = cfg->changes;
+    live_changes = 0;
+}
+
 int restart_threads_by_signal(int &flag)
 {
     // inform main to restart threads
-    std::unique_lock lck(mutex_main);
+    std::unique_lock lck(mutex_restart);
     if (!global_restart_rtsp && !global_restart_video && !global_restart_audio) 
     {
         if ((flag & PNT_FLAG_RESTART_RTSP) || (flag & PNT_FLAG_RESTART_VIDEO) || (flag & PNT_FLAG_RESTART_AUDIO))
@@ -556,27 +631,63 @@ int restart_threads_by_signal(int &flag)
     return 0;
 }
 
-bool get_snapshot(std::vector<unsigned char> &image)
+#define MJPEG_BOUNDARY "prudyntmjpegframe"
+#define MJPEG_PART_MAX 128
+
+static_assert(LWS_PRE + MJPEG_PART_MAX <= Snapshot::headroom, "snapshot headroom too small");
+
+// http urls of the jpeg channels, stream2 and stream3
+static const char *const preview_urls[NUM_VIDEO_CHANNELS] = {"/preview.jpg", "/preview1.jpg"};
+static const char *const mjpeg_urls[NUM_VIDEO_CHANNELS] = {"/mjpeg", "/mjpeg1"};
+
+// http connections receiving /mjpeg per jpeg channel, only used by the lws service thread
+static std::set<struct lws *> mjpeg_clients[NUM_VIDEO_CHANNELS];
+
+// index of url in urls, -1 if it is none of them
+static int jpeg_channel_by_url(const char *const urls[NUM_VIDEO_CHANNELS], const char *url)
 {
-    std::ifstream file(global_jpeg[0]->stream->jpeg_path, std::ios::binary);
-    if (!file.is_open())
+    for (int i = 0; i < NUM_VIDEO_CHANNELS; i++)
     {
-        LOG_DDEBUGWS(strerror(errno));
-        return false;
+        if (strcmp(url, urls[i]) == 0)
+            return i;
     }
+    return -1;
+}
+
+// a disabled jpeg channel never wakes up, don't wait for it
+static bool jpeg_available(int jpgChn)
+{
+    return global_jpeg[jpgChn] && global_jpeg[jpgChn]->running;
+}
 
-    file.seekg(0, std::ios::end);
-    size_t file_size = file.tellg();
-    if (file_size)
+// latest image of the jpeg channel, nullptr if there is none yet
+std::shared_ptr<const Snapshot::Image> get_snapshot(int jpgChn)
+{
+    if (!global_jpeg[jpgChn])
+        return nullptr;
+
+    auto img = global_jpeg[jpgChn]->snapshot.get();
+    if (!img || !img->size())
     {
-        image.resize(LWS_PRE + file_size);
-        file.seekg(0, std::ios::beg);
-        file.read(reinterpret_cast<char *>(image.data() + LWS_PRE), file_size);
-        file.close();
-        return true;
+        LOG_DDEBUGWS("no snapshot available");
+        return nullptr;
     }
+    return img;
+}
 
-    return false;
+/* lws_write() puts its frame header into the LWS_PRE bytes in front of
+ * the payload. The image is shared, but its headroom is only ever used
+ * by the lws service thread, one write at a time.
+ */
+static unsigned char *snapshot_payload(const Snapshot::Image &img)
+{
+    return const_cast<unsigned char *>(img.data());
+}
+
+// keep the jpeg channel producing images, request() wakes it up if it sleeps
+static void keep_jpeg_running(int jpgChn)
+{
+    global_jpeg[jpgChn]->request();
 }
 
 template <typename... Args>
@@ -662,6 +773,14 @@ signed char WS::general_callback(struct lejp_ctx *ctx, char reason)
                 }
                 add_json_str(u_ctx->message, cfg->get<const char *>(u_ctx->path));                
                 break;                    
+            case PNT_GENERAL_LATENCY_TRACE:
+                if (reason == LEJPCB_VAL_TRUE || reason == LEJPCB_VAL_FALSE)
+                {
+                    cfg->set<bool>(u_ctx->path, reason == LEJPCB_VAL_TRUE);
+                    Tracer::instance().enable(cfg->general.latency_trace);
+                }
+                add_json_bool(u_ctx->message, cfg->get<bool>(u_ctx->path));
+                break;
             default:
                 u_ctx->flag &= ~PNT_FLAG_SEPARATOR;
                 break;
@@ -691,7 +810,7 @@ signed char WS::rtsp_callback(struct lejp_ctx *ctx, char reason)
         u_ctx->flag |= PNT_FLAG_SEPARATOR;
 
         // int values
-        if (ctx->path_match >= PNT_RTSP_PORT && ctx->path_match <= PNT_RTSP_SEND_BUFFER_SIZE)
+        if (ctx->path_match >= PNT_RTSP_PORT && ctx->path_match <= PNT_RTSP_MULTICAST_TTL)
         {
             if (reason == LEJPCB_VAL_NUM_INT)
             {
@@ -704,7 +823,7 @@ signed char WS::rtsp_callback(struct lejp_ctx *ctx, char reason)
             add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
             // const char * values
         }
-        else if (ctx->path_match >= PNT_RTSP_NAME && ctx->path_match <= PNT_RTSP_PASSWORD)
+        else if (ctx->path_match >= PNT_RTSP_NAME && ctx->path_match <= PNT_RTSP_MULTICAST_ADDRESS)
         {
             if (reason == LEJPCB_VAL_STR_END)
             {
@@ -721,6 +840,10 @@ signed char WS::rtsp_callback(struct lejp_ctx *ctx, char reason)
             switch (ctx->path_match)
             {
             case PNT_RTSP_AUTH_REQUIRED:
+            case PNT_RTSP_MULTICAST:
+            case PNT_RTSP_MULTICAST_SSM:
+            case PNT_RTSP_SHARED_PACKETIZATION:
+            case PNT_RTSP_BATCH_SEND:
                 if (reason == LEJPCB_VAL_TRUE)
                 {
                     if (cfg->set<bool>(u_ctx->path, true))
@@ -1272,7 +1395,19 @@ signed char WS::stream_callback(struct lejp_ctx *ctx, char reason)
         if (ctx->path_match >= PNT_STREAM_GOP && ctx->path_match <= PNT_STREAM_PROFILE)
         { // integer values
             if (reason == LEJPCB_VAL_NUM_INT)
-                cfg->set<int>(u_ctx->path, atoi(ctx->buf));
+            {
+                unsigned int changes = cfg->changes;
+                int value = atoi(ctx->buf);
+                bool live = ctx->path_match == PNT_STREAM_BITRATE || ctx->path_match == PNT_STREAM_GOP ||
+                            (ctx->path_match == PNT_STREAM_FPS && value <= global_video[u_ctx->value]->source_fps);
+
+                // bitrate, gop and lower fps are applied to the running encoder of this stream only
+                if (cfg->set<int>(u_ctx->path, value) && live && cfg->changes != changes)
+                {
+                    live_changes += cfg->changes - changes;
+                    global_video[u_ctx->value]->reconfigure = true;
+                }
+            }
             add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
         }
         else if(ctx->path_match >= PNT_STREAM_ENABLED && ctx->path_match <= PNT_STREAM_SCALE_ENABLED)
@@ -1410,6 +1545,7 @@ signed char WS::stream2_callback(struct lejp_ctx *ctx, char reason)
             add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
             break;
         case PNT_STREAM2_FPS:
+        case PNT_STREAM2_JPEG_SAVE_INTERVAL:
             if (reason == LEJPCB_VAL_NUM_INT)
             {
                 if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
@@ -1437,6 +1573,11 @@ signed char WS::stream2_callback(struct lejp_ctx *ctx, char reason)
                     fps = cfg->stream2.stats.fps;
                     bps = cfg->stream2.stats.bps;
                 }
+                else if (is_stream(u_ctx->root, "stream3"))
+                {
+                    fps = cfg->stream3.stats.fps;
+                    bps = cfg->stream3.stats.bps;
+                }
                 append_session_msg(
                     u_ctx->message, "{\"fps\":%d,\"Bps\":%d}", fps, bps);
             }
@@ -1523,7 +1664,7 @@ signed char WS::osd_callback(struct lejp_ctx *ctx, char reason)
             add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
         }
         // integer
-        else if (ctx->path_match >= PNT_OSD_FONT_SIZE && ctx->path_match <= PNT_OSD_UPTIME_ROTATION)
+        else if (ctx->path_match >= PNT_OSD_FONT_SIZE && ctx->path_match <= PNT_OSD_POS_BITRATE_GRAPH_Y)
         {
             if (reason == LEJPCB_VAL_NUM_INT)
             {
@@ -1532,7 +1673,7 @@ signed char WS::osd_callback(struct lejp_ctx *ctx, char reason)
             add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
         }
         // bool
-        else if (ctx->path_match >= PNT_OSD_ENABLED && ctx->path_match <= PNT_OSD_LOGO_ENABLED)
+        else if (ctx->path_match >= PNT_OSD_ENABLED && ctx->path_match <= PNT_OSD_BITRATE_GRAPH_ENABLED)
         {
             if (reason == LEJPCB_VAL_TRUE)
             {
@@ -1828,6 +1969,172 @@ signed char WS::motion_roi_callback(struct lejp_ctx *ctx, char reason)
     return 0;
 }
 
+// "key":{"count":..,"avg_us":..,"p50_us":..,"p90_us":..,"p99_us":..}
+static void append_histogram_json(std::string &message, const char *key, const Metrics::Histogram::Snapshot &h)
+{
+    append_session_msg(
+        message, "\"%s\":{\"count\":%llu,\"avg_us\":%llu,\"p50_us\":%u,\"p90_us\":%u,\"p99_us\":%u}",
+        key, (unsigned long long)h.count, (unsigned long long)(h.count ? h.sum_us / h.count : 0),
+        h.percentile(0.5), h.percentile(0.9), h.percentile(0.99));
+}
+
+// the sessions of a video stream, copied so they can be printed unlocked
+static std::vector<std::shared_ptr<session_stats>> video_sessions(int encChn)
+{
+    std::lock_guard lock_stream{global_video[encChn]->mtx};
+    return global_video[encChn]->sessions;
+}
+
+// json array with the encoder_stats and sessions of every video stream
+static void append_encoder_stats(std::string &message)
+{
+    message.append("[");
+    for (int i = 0; i < NUM_VIDEO_CHANNELS; i++)
+    {
+        if (!global_video[i])
+            continue;
+        const encoder_stats &st = global_video[i]->stats;
+        append_session_msg(
+            message, "%s{\"stream\":\"%s\",\"left_pics\":%lld,\"left_stream_bytes\":%lld,\"left_stream_frames\":%lld,",
+            i ? "," : "", global_video[i]->name, (long long)st.left_pics.value(), (long long)st.left_stream_bytes.value(),
+            (long long)st.left_stream_frames.value());
+        append_session_msg(
+            message, "\"polling_timeouts\":%llu,\"getstream_errors\":%llu,\"channel_overruns\":%llu,",
+            (unsigned long long)st.polling_timeouts.value(), (unsigned long long)st.getstream_errors.value(),
+            (unsigned long long)st.channel_overruns.value());
+        append_histogram_json(message, "latency", st.latency.snapshot());
+        message.append(",");
+        append_histogram_json(message, "send_latency", st.send_latency.snapshot());
+        message.append(",\"sessions\":[");
+
+        bool first = true;
+        for (auto &ss : video_sessions(i))
+        {
+            append_session_msg(
+                message, "%s{\"id\":%u,\"tcp\":%s,\"frames\":%llu,\"oversize_drops\":%u,"
+                "\"congestion_drops\":%u,\"lagged\":%u,\"lag_drops\":%u}",
+                first ? "" : ",", ss->id, ss->tcp ? "true" : "false", (unsigned long long)ss->frames.load(),
+                ss->oversize_drops.load(), ss->congestion_drops.load(), ss->lagged.load(), ss->lag_drops.load());
+            first = false;
+        }
+        message.append("]}");
+    }
+    message.append("]");
+}
+
+// json array of all registered metrics, histograms as percentiles
+static void append_metrics(std::string &message)
+{
+    message.append("[");
+    bool first = true;
+    for (auto &sample : Metrics::instance().snapshot())
+    {
+        message.append(first ? "{" : ",{");
+        first = false;
+        add_json_key(message, false, "name");
+        add_json_str(message, sample.name.c_str());
+        add_json_key(message, true, "labels");
+        // the label values are plain names, only the quotes need escaping
+        message.append("\"");
+        for (char c : sample.labels)
+        {
+            if (c == '"')
+                message.append("\\");
+            message.push_back(c);
+        }
+        message.append("\",");
+        if (sample.type == Metrics::HISTOGRAM)
+            append_histogram_json(message, "value", sample.histogram);
+        else
+            append_session_msg(message, "\"value\":%lld", (long long)sample.value);
+        message.append("}");
+    }
+    message.append("]");
+}
+
+static void append_metric_header(std::string &message, const char *name, const char *type, const char *help)
+{
+    append_session_msg(message, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// name{labels} with optional extra label, labels may be empty
+static void append_metric_name(std::string &message, const std::string &name, const char *suffix,
+                               const std::string &labels, const char *extra = nullptr)
+{
+    message.append(name);
+    message.append(suffix);
+    if (labels.empty() && !extra)
+        return;
+    message.append("{");
+    message.append(labels);
+    if (extra)
+    {
+        if (!labels.empty())
+            message.append(",");
+        message.append(extra);
+    }
+    message.append("}");
+}
+
+// all registered metrics and the RTSP sessions in Prometheus text format, for GET /metrics
+static std::string prometheus_metrics()
+{
+    std::string message;
+    static const char *const types[] = {"counter", "gauge", "histogram"};
+
+    // samples of a metric family have to be adjacent
+    auto samples = Metrics::instance().snapshot();
+    std::stable_sort(samples.begin(), samples.end(),
+                     [](const Metrics::Sample &a, const Metrics::Sample &b) { return a.name < b.name; });
+
+    for (size_t n = 0; n < samples.size(); n++)
+    {
+        const Metrics::Sample &sample = samples[n];
+        if (n == 0 || samples[n - 1].name != sample.name)
+            append_metric_header(message, sample.name.c_str(), types[sample.type], sample.help);
+
+        if (sample.type != Metrics::HISTOGRAM)
+        {
+            append_metric_name(message, sample.name, "", sample.labels);
+            append_session_msg(message, " %lld\n", (long long)sample.value);
+            continue;
+        }
+
+        // histograms are recorded in µs and exported in seconds
+        const Metrics::Histogram::Snapshot &h = sample.histogram;
+        uint64_t count = 0;
+        for (size_t b = 0; b < Metrics::Histogram::num_buckets; b++)
+        {
+            char le[32];
+            count += h.buckets[b];
+            if (b < Metrics::Histogram::num_buckets - 1)
+                snprintf(le, sizeof(le), "le=\"%g\"", Metrics::Histogram::bounds[b] / 1000000.0);
+            else
+                snprintf(le, sizeof(le), "le=\"+Inf\"");
+            append_metric_name(message, sample.name, "_bucket", sample.labels, le);
+            append_session_msg(message, " %llu\n", (unsigned long long)count);
+        }
+        append_metric_name(message, sample.name, "_sum", sample.labels);
+        append_session_msg(message, " %g\n", h.sum_us / 1000000.0);
+        append_metric_name(message, sample.name, "_count", sample.labels);
+        append_session_msg(message, " %llu\n", (unsigned long long)h.count);
+    }
+
+    // sessions come and go, they are not in the registry
+    append_metric_header(message, "prudynt_session_frames_total", "counter",
+                         "NAL units delivered to an RTSP session.");
+    for (int i = 0; i < NUM_VIDEO_CHANNELS; i++)
+    {
+        if (!global_video[i])
+            continue;
+        for (auto &ss : video_sessions(i))
+            append_session_msg(message, "prudynt_session_frames_total{stream=\"%s\",session=\"%u\",transport=\"%s\"} %llu\n",
+                               global_video[i]->name, ss->id, ss->tcp ? "tcp" : "udp", (unsigned long long)ss->frames.load());
+    }
+
+    return message;
+}
+
 signed char WS::info_callback(struct lejp_ctx *ctx, char reason)
 {
     struct user_ctx *u_ctx = (struct user_ctx *)ctx->user;
@@ -1856,6 +2163,27 @@ signed char WS::info_callback(struct lejp_ctx *ctx, char reason)
                 }
             }
             break;
+        case PNT_INFO_BUFFER_POOL:
+            {
+                // size 0 counts the requests larger than every size class
+                u_ctx->message.append("[");
+                bool first = true;
+                for (auto &st : BufferPool::instance().stats())
+                {
+                    append_session_msg(
+                        u_ctx->message, "%s{\"size\":%u,\"hits\":%u,\"misses\":%u,\"buffers\":%u,\"in_use\":%u}",
+                        first ? "" : ",", (unsigned int)st.size, st.hits, st.misses, st.buffers, st.in_use);
+                    first = false;
+                }
+                u_ctx->message.append("]");
+            }
+            break;
+        case PNT_INFO_ENCODER_STATS:
+            append_encoder_stats(u_ctx->message);
+            break;
+        case PNT_INFO_METRICS:
+            append_metrics(u_ctx->message);
+            break;
         default:
             u_ctx->flag &= ~PNT_FLAG_SEPARATOR;
             break;               
@@ -1898,17 +2226,28 @@ signed char WS::action_callback(struct lejp_ctx *ctx, char reason)
                 }
                 if (thread_restart & PNT_THREAD_VIDEO)
                 {
-                    restart_flag |= PNT_FLAG_RESTART_VIDEO;
+                    if (!(thread_restart & PNT_THREAD_RTSP) && !video_restart_required())
+                    {
+                        LOG_DEBUG("video parameters applied to the running encoders, skip video restart");
+                        video_restart_done();
+                    }
+                    else
+                    {
+                        restart_flag |= PNT_FLAG_RESTART_VIDEO;
+                    }
                 }
                 if (thread_restart & PNT_THREAD_AUDIO)
                 {
                     restart_flag |= PNT_FLAG_RESTART_AUDIO;
                 }
                 if (restart_flag) {
+                    bool restart_video = restart_flag & PNT_FLAG_RESTART_VIDEO;
                     if(restart_threads_by_signal(restart_flag) < 0)
                         msg_id = PNT_WS_MSG_DROPPED;
+                    else if (restart_video)
+                        video_restart_done();
                 }
-                else
+                else if (!(thread_restart & PNT_THREAD_VIDEO))
                 {
                     msg_id = PNT_WS_MSG_ERROR;
                 }
@@ -1924,6 +2263,10 @@ signed char WS::action_callback(struct lejp_ctx *ctx, char reason)
             add_json_str(u_ctx->message, pnt_ws_msg[PNT_WS_MSG_INITIATED]); 
             break;
         case PNT_CAPTURE:
+            // "capture":null for the first jpeg channel, "capture":1 for the second one
+            u_ctx->snapshot.channel = 0;
+            if (reason == LEJPCB_VAL_NUM_INT && atoi(ctx->buf) > 0 && atoi(ctx->buf) < NUM_VIDEO_CHANNELS)
+                u_ctx->snapshot.channel = atoi(ctx->buf);
             u_ctx->flag |= PNT_FLAG_WS_REQUEST_PREVIEW;
             add_json_str(u_ctx->message, pnt_ws_msg[PNT_WS_MSG_INITIATED]); 
             break;
@@ -1993,6 +2336,7 @@ signed char WS::root_callback(struct lejp_ctx *ctx, char reason)
                              stream_keys, LWS_ARRAY_SIZE(stream_keys), stream_callback);
             break;
         case PNT_STREAM2:
+        case PNT_STREAM3:
             lejp_parser_push(ctx, u_ctx,
                              stream2_keys, LWS_ARRAY_SIZE(stream2_keys), stream2_callback);
             break;
@@ -2116,11 +2460,15 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
         //u_ctx->flag |= PNT_FLAG_WS_REQUEST_PENDING;
 
         // parse json and write response into u_ctx->message
-        u_ctx->message = "{";               // open response json 
-        lejp_construct(&ctx, root_callback, u_ctx, root_keys, LWS_ARRAY_SIZE(root_keys));
-        lejp_parse(&ctx, (uint8_t *)u_ctx->rx_message.c_str(), u_ctx->rx_message.length());
-        lejp_destruct(&ctx);
-        u_ctx->message.append("}");         // close response json
+        {
+            auto request_start = steady_clock::now();
+            u_ctx->message = "{";               // open response json 
+            lejp_construct(&ctx, root_callback, u_ctx, root_keys, LWS_ARRAY_SIZE(root_keys));
+            lejp_parse(&ctx, (uint8_t *)u_ctx->rx_message.c_str(), u_ctx->rx_message.length());
+            lejp_destruct(&ctx);
+            u_ctx->message.append("}");         // close response json
+            request_time.observe(duration_cast<microseconds>(steady_clock::now() - request_start).count());
+        }
         u_ctx->rx_message.clear();          // cleanup received data
         u_ctx->flag &= ~PNT_FLAG_SEPARATOR; // always reset separator after parsing
 
@@ -2154,18 +2502,20 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
             int first_request_delay = 0;
             u_ctx->snapshot.r++;
 
+            if (jpeg_available(u_ctx->snapshot.channel))
             {
-                global_jpeg[0]->request();
+                auto &jpeg = global_jpeg[u_ctx->snapshot.channel];
+                jpeg->request();
 
                 /* if the jpeg channel is inactive we need to start him
                 * this can also cause that required video channel also
                 * must been started
                 */
-                if (!global_jpeg[0]->active)
+                if (!jpeg->active)
                 {
                     first_request_delay = cfg->websocket.first_image_delay * 1000;
-                    global_jpeg[0]->should_grab_frames.notify_all();
-                    global_jpeg[0]->is_activated.acquire();
+                    jpeg->wake();
+                    jpeg->is_activated.acquire();
                 }
             }
 
@@ -2182,7 +2532,7 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
                 u_ctx->snapshot.r = 0;
                 
                 u_ctx->snapshot.throttle +=
-                    global_jpeg[0]->stream->stats.fps - u_ctx->snapshot.rps;
+                    global_jpeg[u_ctx->snapshot.channel]->stream->stats.fps - u_ctx->snapshot.rps;
                 
                 if (u_ctx->snapshot.throttle > 100)
                 {
@@ -2196,7 +2546,7 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
                 LOG_DDEBUGWS("RPS: " << u_ctx->snapshot.rps << " " << u_ctx->snapshot.throttle << " " << dur);
             }
 
-            int delay = (LWS_USEC_PER_SEC / (global_jpeg[0]->stream->stats.fps + u_ctx->snapshot.throttle)) + first_request_delay;
+            int delay = (LWS_USEC_PER_SEC / (global_jpeg[u_ctx->snapshot.channel]->stream->stats.fps + u_ctx->snapshot.throttle)) + first_request_delay;
             LOG_DDEBUGWS("shedule preview image. id:" << u_ctx->id << " delay:" << delay);
             lws_sul_schedule(lws_get_context(wsi), 0, &u_ctx->sul, send_snapshot, delay);
 
@@ -2240,14 +2590,27 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
         // delayed snapshot request via websocket, sending the image
         if (u_ctx->flag & PNT_FLAG_WS_SEND_PREVIEW)
         {
-            LOG_DDEBUGWS("send preview image. id:" << u_ctx->id);
-            global_jpeg[0]->request();
-            std::vector<unsigned char> jpeg_buf;
-            if (get_snapshot(jpeg_buf))
+            u_ctx->flag &= ~PNT_FLAG_WS_SEND_PREVIEW;
+            global_jpeg[u_ctx->snapshot.channel]->request();
+            auto img = get_snapshot(u_ctx->snapshot.channel);
+
+            // the client has this image already, look again in 10ms
+            if (img && img->generation == u_ctx->snapshot.generation && u_ctx->snapshot.stale < 10)
             {
-                lws_write(wsi, jpeg_buf.data() + LWS_PRE, jpeg_buf.size() - LWS_PRE, LWS_WRITE_BINARY);
+                u_ctx->snapshot.stale++;
+                lws_sul_schedule(lws_get_context(wsi), 0, &u_ctx->sul, send_snapshot, LWS_USEC_PER_SEC / 100);
+            }
+            else
+            {
+                LOG_DDEBUGWS("send preview image. id:" << u_ctx->id);
+                if (img)
+                {
+                    lws_write(wsi, snapshot_payload(*img), img->size(), LWS_WRITE_BINARY);
+                    u_ctx->snapshot.generation = img->generation;
+                }
+                u_ctx->snapshot.stale = 0;
+                u_ctx->flag &= ~PNT_FLAG_WS_PREVIEW_PENDING;
             }
-            u_ctx->flag &= ~(PNT_FLAG_WS_SEND_PREVIEW | PNT_FLAG_WS_PREVIEW_PENDING);
         }
         break;
 
@@ -2291,17 +2654,33 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
         // http GET
         if (request_method == 0)
         {
+            int preview_channel = jpeg_channel_by_url(preview_urls, url_ptr);
+            int mjpeg_channel = jpeg_channel_by_url(mjpeg_urls, url_ptr);
+
+            if ((preview_channel >= 0 && !jpeg_available(preview_channel)) ||
+                (mjpeg_channel >= 0 && !jpeg_available(mjpeg_channel)))
+            {
+                LOG_DDEBUGWS("jpeg channel not available, url:" << url_ptr);
+                if (lws_return_http_status(wsi, HTTP_STATUS_NOT_FOUND, NULL) ||
+                    lws_http_transaction_completed(wsi)) {
+                    return -1;
+                }
+                return 0;
+            }
+
             // Send preview image
-            if (strcmp(url_ptr, "/preview.jpg") == 0)
+            if (preview_channel >= 0)
             {
                 u_ctx->flag |= PNT_FLAG_HTTP_SEND_PREVIEW;
+                u_ctx->snapshot.channel = preview_channel;
 
-                global_jpeg[0]->request();
+                auto &jpeg = global_jpeg[preview_channel];
+                jpeg->request();
 
-                if (!global_jpeg[0]->active)
+                if (!jpeg->active)
                 {
-                    global_jpeg[0]->should_grab_frames.notify_all();
-                    global_jpeg[0]->is_activated.acquire();
+                    jpeg->wake();
+                    jpeg->is_activated.acquire();
                     /* we need this delay to grab a valid image when stream resume from sleep
                      * usleep is a bad choice, but lws_sul_schedule won't work as expected here
                      * hopfully we find a better solution later
@@ -2312,6 +2691,44 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
                 lws_callback_on_writable(wsi);
                 return 0;
             }
+
+            // Send the stats in Prometheus text format
+            if (strcmp(url_ptr, "/metrics") == 0)
+            {
+                u_ctx->flag |= PNT_FLAG_HTTP_SEND_METRICS;
+                u_ctx->message = prometheus_metrics();
+                lws_callback_on_writable(wsi);
+                return 0;
+            }
+
+            // Send the latency trace, load it in chrome://tracing or Perfetto
+            if (strcmp(url_ptr, "/trace") == 0)
+            {
+                u_ctx->flag |= PNT_FLAG_HTTP_SEND_TRACE;
+                u_ctx->message = Tracer::instance().dump();
+                lws_callback_on_writable(wsi);
+                return 0;
+            }
+
+            // Send a multipart jpeg stream, a part for every new image
+            if (mjpeg_channel >= 0)
+            {
+                u_ctx->flag |= PNT_FLAG_HTTP_SEND_MJPEG;
+                u_ctx->snapshot.channel = mjpeg_channel;
+                mjpeg_clients[mjpeg_channel].insert(wsi);
+
+                auto &jpeg = global_jpeg[mjpeg_channel];
+                jpeg->request();
+
+                if (!jpeg->active)
+                {
+                    jpeg->wake();
+                    jpeg->is_activated.acquire();
+                }
+
+                lws_callback_on_writable(wsi);
+                return 0;
+            }
         }
         // http POST
         else if (request_method == 1)
@@ -2349,11 +2766,13 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
         if (u_ctx->flag & PNT_FLAG_HTTP_RECEIVED_MESSAGE)
         {
             // parse json and write response into u_ctx->message
+            auto request_start = steady_clock::now();
             u_ctx->message = "{";               // open response json
             lejp_construct(&ctx, root_callback, u_ctx, root_keys, LWS_ARRAY_SIZE(root_keys));
             lejp_parse(&ctx, (uint8_t *)u_ctx->rx_message.c_str(), u_ctx->rx_message.length());
             lejp_destruct(&ctx);
             u_ctx->message.append("}");         // close response json
+            request_time.observe(duration_cast<microseconds>(steady_clock::now() - request_start).count());
             u_ctx->rx_message.clear();          // cleanup received data
             u_ctx->flag &= ~PNT_FLAG_SEPARATOR; // always reset separator after parsing
             u_ctx->flag |= PNT_FLAG_HTTP_SEND_MESSAGE;
@@ -2381,17 +2800,63 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
             uint8_t *p = &header[LWS_PRE];
             uint8_t *end = &header[sizeof(header) - 1];
 
+            if (u_ctx->flag & PNT_FLAG_HTTP_SEND_MJPEG)
+            {
+                u_ctx->flag &= ~PNT_FLAG_HTTP_SEND_MJPEG;
+                u_ctx->flag |= PNT_FLAG_HTTP_MJPEG_STREAM;
+
+                if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "multipart/x-mixed-replace; boundary=" MJPEG_BOUNDARY,
+                                                LWS_ILLEGAL_HTTP_CONTENT_LEN, &p, end) ||
+                    lws_finalize_write_http_header(wsi, start, &p, end))
+                {
+                    LOG_ERROR("lws error sending mjpeg header");
+                    return 1;
+                }
+
+                // the response never completes
+                lws_set_timeout(wsi, NO_PENDING_TIMEOUT, 0);
+                lws_callback_on_writable(wsi);
+                return 0;
+            }
+
+            if (u_ctx->flag & PNT_FLAG_HTTP_MJPEG_STREAM)
+            {
+                keep_jpeg_running(u_ctx->snapshot.channel);
+
+                /* always send the latest image, images published while the
+                 * client was not writable are skipped
+                 */
+                auto img = get_snapshot(u_ctx->snapshot.channel);
+                if (!img || img->generation == u_ctx->snapshot.generation)
+                    return 0;
+
+                // the part header goes into the headroom in front of the image
+                char part[MJPEG_PART_MAX];
+                int n = snprintf(part, sizeof(part), "\r\n--" MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n",
+                                 (unsigned int)img->size());
+                unsigned char *buf = snapshot_payload(*img) - n;
+                memcpy(buf, part, n);
+
+                if (lws_write(wsi, buf, n + img->size(), LWS_WRITE_HTTP) < 0)
+                {
+                    LOG_DDEBUGWS("lws error sending mjpeg frame ip:" << client_ip);
+                    return -1;
+                }
+                u_ctx->snapshot.generation = img->generation;
+                return 0;
+            }
+
             if (u_ctx->flag & PNT_FLAG_HTTP_SEND_PREVIEW)
             {
                 u_ctx->flag &= ~PNT_FLAG_HTTP_SEND_PREVIEW;
 
                 // Write image
-                std::vector<unsigned char> jpeg_buf;
-                if (get_snapshot(jpeg_buf))
+                auto img = get_snapshot(u_ctx->snapshot.channel);
+                if (img)
                 {
-                    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "image/jpeg", jpeg_buf.size() - LWS_PRE, &p, end) ||
+                    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "image/jpeg", img->size(), &p, end) ||
                         lws_finalize_write_http_header(wsi, start, &p, end) ||
-                        !lws_write(wsi, jpeg_buf.data() + LWS_PRE, jpeg_buf.size() - LWS_PRE, LWS_WRITE_BINARY) ||
+                        !lws_write(wsi, snapshot_payload(*img), img->size(), LWS_WRITE_BINARY) ||
                         lws_http_transaction_completed(wsi))
                     {
 
@@ -2405,6 +2870,22 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
                 }
             }
 
+            if (u_ctx->flag & (PNT_FLAG_HTTP_SEND_METRICS | PNT_FLAG_HTTP_SEND_TRACE))
+            {
+                const char *type = (u_ctx->flag & PNT_FLAG_HTTP_SEND_TRACE) ? "application/json" : "text/plain; version=0.0.4";
+                u_ctx->flag &= ~(PNT_FLAG_HTTP_SEND_METRICS | PNT_FLAG_HTTP_SEND_TRACE);
+
+                if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, type, u_ctx->message.length(), &p, end) ||
+                    lws_finalize_write_http_header(wsi, start, &p, end) ||
+                    !lws_write(wsi, (unsigned char *)u_ctx->message.c_str(), u_ctx->message.length(), LWS_WRITE_HTTP) ||
+                    lws_http_transaction_completed(wsi))
+                {
+                    LOG_ERROR("lws error sending " << type);
+                    return -1;
+                }
+                return 0;
+            }
+
             if (u_ctx->flag & PNT_FLAG_HTTP_SEND_MESSAGE)
             {
                 u_ctx->flag &= ~PNT_FLAG_HTTP_SEND_MESSAGE;
@@ -2444,9 +2925,23 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
 
     case LWS_CALLBACK_HTTP_DROP_PROTOCOL:
         LOG_DDEBUGWS("LWS_CALLBACK_HTTP_DROP_PROTOCOL ip:" << client_ip << ", id:" << u_ctx->id);
+        for (auto &clients : mjpeg_clients)
+            clients.erase(wsi);
         u_ctx->~user_ctx();
         break;
 
+    case LWS_CALLBACK_CLOSED_HTTP:
+        for (auto &clients : mjpeg_clients)
+            clients.erase(wsi);
+        break;
+
+    // a new snapshot was published, see WS::start()
+    case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+        for (auto &clients : mjpeg_clients)
+            for (auto client : clients)
+                lws_callback_on_writable(client);
+        break;
+
     default:
         break;
     }
@@ -2492,9 +2987,22 @@ void WS::start()
 
     LOG_INFO("Server started on port " << cfg->websocket.port);
 
+    // wake the service loop for every new image, mjpeg clients are waiting
+    for (auto &jpeg : global_jpeg)
+    {
+        jpeg->snapshot.set_listener([this]()
+        { lws_cancel_service(context); });
+    }
+
     while (true)
     {
         lws_service(context, 50);
+
+        for (int i = 0; i < NUM_VIDEO_CHANNELS; i++)
+        {
+            if (!mjpeg_clients[i].empty())
+                keep_jpeg_running(i);
+        }
     }
 
     LOG_INFO("Server stopped.");
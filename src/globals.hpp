@@ -2,64 +2,188 @@
 #define GLOBALS_HPP
 
 #include <memory>
+#include <deque>
+#include <vector>
+#include <string>
 #include <functional>
 #include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include "liveMedia.hh"
 
 #include "MsgChannel.hpp"
+#include "BroadcastChannel.hpp"
+#include "FrameData.hpp"
+#include "Snapshot.hpp"
+#include "LockOrder.hpp"
+#include "Metrics.hpp"
 #include "IMPAudio.hpp"
 #include "IMPEncoder.hpp"
 #include "IMPFramesource.hpp"
 
 #define MSG_CHANNEL_SIZE 20
+/* encoder streams which may be held by queued NAL units, at the limit
+ * the queued NAL units are copied out of them, see can_pin() */
+#define MAX_PINNED_STREAMS 2
 #define NUM_AUDIO_CHANNELS 1
 #define NUM_VIDEO_CHANNELS 2
 
 using namespace std::chrono;
 
-extern std::mutex mutex_main; // protects global_restart_rtsp and global_restart_video
+/* Each stream has its own mutex for the state its grabber thread waits
+ * for, mutex_restart only serializes restart requests to the main thread.
+ * See LockOrder.hpp for the order they may be nested in.
+ */
+extern OrderedMutex mutex_restart;
 
 struct AudioFrame
 {
-	std::vector<uint8_t> data;
+	FrameData data;
 	struct timeval time;
+	int64_t imp_ts;
 };
 
 struct H264NALUnit
 {
-	std::vector<uint8_t> data;
+	FrameData data;
 	struct timeval time;
 	int64_t imp_ts;
 };
 
+/* Delivery counters of an IMPDeviceSource, i.e. of one RTSP session,
+ * or of all sessions if they share the source. Written by the RTSP
+ * thread, read by the stats endpoints.
+ */
+struct session_stats
+{
+    uint32_t id;
+    std::atomic<bool> tcp{false};              // RTP over TCP
+    std::atomic<uint32_t> frames{0};           // NAL units delivered
+    std::atomic<uint32_t> oversize_drops{0};   // larger than the sink buffer
+    std::atomic<uint32_t> congestion_drops{0}; // send queue over tcp_queue_limit
+    std::atomic<uint32_t> lagged{0};           // fell behind the channel, skipped to a keyframe
+    std::atomic<uint32_t> lag_drops{0};        // NAL units skipped that way
+
+    explicit session_stats(uint32_t id) : id(id) {}
+};
+
+// prometheus label of a stream's metrics
+inline std::string metric_label(const char *stream)
+{
+    return std::string("stream=\"") + stream + "\"";
+}
+
+/* Encoder channel and delivery metrics of a video stream, registered
+ * in Metrics::instance(). The encoder side is written by the
+ * stream_grabber thread, the drops and send latency by the RTSP thread.
+ */
+struct encoder_stats
+{
+    // IMP_Encoder_Query, refreshed once per second
+    Metrics::Gauge &left_pics;
+    Metrics::Gauge &left_stream_bytes;
+    Metrics::Gauge &left_stream_frames;
+
+    Metrics::Counter &polling_timeouts;
+    Metrics::Counter &getstream_errors;
+    Metrics::Counter &channel_overruns; // msgChannel writes a reader lagged on
+
+    Metrics::Histogram &latency;      // frame age at IMP_Encoder_GetStream
+    Metrics::Histogram &send_latency; // frame age when handed to live555
+
+    // summed over all sessions, see session_stats
+    Metrics::Counter &oversize_drops;
+    Metrics::Counter &congestion_drops;
+    Metrics::Counter &lag_drops;
+
+    explicit encoder_stats(const char *stream)
+        : left_pics(Metrics::instance().gauge("prudynt_encoder_left_pics",
+                                              "Pictures queued for encoding.", metric_label(stream))),
+          left_stream_bytes(Metrics::instance().gauge("prudynt_encoder_left_stream_bytes",
+                                                      "Encoded bytes not yet fetched from the encoder.", metric_label(stream))),
+          left_stream_frames(Metrics::instance().gauge("prudynt_encoder_left_stream_frames",
+                                                       "Encoded frames not yet fetched from the encoder.", metric_label(stream))),
+          polling_timeouts(Metrics::instance().counter("prudynt_encoder_polling_timeouts_total",
+                                                       "IMP_Encoder_PollingStream timeouts.", metric_label(stream))),
+          getstream_errors(Metrics::instance().counter("prudynt_encoder_getstream_errors_total",
+                                                       "IMP_Encoder_GetStream failures.", metric_label(stream))),
+          channel_overruns(Metrics::instance().counter("prudynt_channel_overruns_total",
+                                                       "NAL units written while a reader lagged behind.", metric_label(stream))),
+          latency(Metrics::instance().histogram("prudynt_encoder_latency_seconds",
+                                                "Frame age at IMP_Encoder_GetStream.", metric_label(stream))),
+          send_latency(Metrics::instance().histogram("prudynt_capture_to_send_seconds",
+                                                     "Frame age when it is passed to the RTP sink.", metric_label(stream))),
+          oversize_drops(Metrics::instance().counter("prudynt_oversize_drops_total",
+                                                     "NAL units larger than the RTP sink buffer.", metric_label(stream))),
+          congestion_drops(Metrics::instance().counter("prudynt_congestion_drops_total",
+                                                       "NAL units dropped for a full RTP over TCP send queue.", metric_label(stream))),
+          lag_drops(Metrics::instance().counter("prudynt_lag_drops_total",
+                                                "NAL units skipped by sessions which fell behind.", metric_label(stream))) {}
+};
+
 struct jpeg_stream
 {
     int encChn;
     int streamChn;
     _stream *stream;
+    const char *name;
     std::atomic<bool> running; // set to false to make jpeg_grabber thread exit
     std::atomic<bool> active{false};
     pthread_t thread;
     IMPEncoder *imp_encoder;
-    std::condition_variable should_grab_frames;
+    OrderedMutex mtx{LOCK_LEVEL_STREAM, "jpeg_stream"}; // protects the should_grab_frames wait
+    std::condition_variable_any should_grab_frames;
     std::binary_semaphore is_activated{0};
+    Snapshot snapshot; // latest image, served by HTTP / WS
 
-    steady_clock::time_point last_image;
-    steady_clock::time_point last_subscriber;
+    steady_clock::time_point last_image; // only used by the jpeg_grabber thread
+    std::atomic<uint32_t> last_subscriber{0}; // steady_clock ms of the last request, wraps around
+    int wake_fd; // eventfd, interrupts the jpeg_grabber waiting for the next frame
+    Metrics::Histogram &encode_time; // capture to published snapshot
 
+    /* Called for every image request. Lock free, unless the grabber
+     * has to be woken up: it sleeps or waits at jpeg_idle_fps.
+     */
     void request()
     {
-        auto now = steady_clock::now();
-        std::unique_lock lck(mutex_main);
-        last_subscriber = now;
+        uint32_t now = now_ms();
+        uint32_t last = last_subscriber.exchange(now);
+        if (!active || now - last >= 1000)
+            wake();
     }
 
     bool request_or_overrun() {
-        return duration_cast<milliseconds>(steady_clock::now() - last_subscriber).count() < 1000;
+        return now_ms() - last_subscriber.load() < 1000;
+    }
+
+    // 32 bit, MIPS32 has no 64 bit atomics, differences survive the wrap
+    static uint32_t now_ms()
+    {
+        return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
     }
 
-    jpeg_stream(int encChn, _stream *stream)
-        : encChn(encChn), stream(stream), running(false), imp_encoder(nullptr) {}
+    void wake()
+    {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {}
+        std::lock_guard lck(mtx);
+        should_grab_frames.notify_all();
+    }
+
+    jpeg_stream(int encChn, _stream *stream, const char *name)
+        : encChn(encChn), streamChn(stream->jpeg_channel), stream(stream), name(name), running(false), imp_encoder(nullptr),
+          wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          encode_time(Metrics::instance().histogram("prudynt_jpeg_encode_seconds",
+                                                    "Time from capture until the JPEG is published.", metric_label(name))) {}
+
+    ~jpeg_stream()
+    {
+        if (wake_fd >= 0)
+            close(wake_fd);
+    }
 };
 
 struct audio_stream
@@ -68,7 +192,7 @@ struct audio_stream
     int aiChn;
     int aeChn;
     bool running;
-    bool active{false};
+    std::atomic<bool> active{false};
     pthread_t thread;
     IMPAudio *imp_audio;
     std::shared_ptr<MsgChannel<AudioFrame>> msgChannel;
@@ -79,8 +203,9 @@ struct audio_stream
      * is registered right now.
      */
     std::atomic<bool> hasDataCallback;
-    std::mutex onDataCallbackLock; // protects onDataCallback from deallocation
-    std::condition_variable should_grab_frames;
+    OrderedMutex onDataCallbackLock{LOCK_LEVEL_CALLBACK, "onDataCallbackLock"}; // protects onDataCallback from deallocation
+    OrderedMutex mtx{LOCK_LEVEL_STREAM, "audio_stream"}; // protects the should_grab_frames wait
+    std::condition_variable_any should_grab_frames;
     std::binary_semaphore is_activated{0};
     
     // Base timestamp for synchronizing with video
@@ -89,10 +214,21 @@ struct audio_stream
 
     StreamReplicator *streamReplicator = nullptr;
 
+    Metrics::Histogram &send_latency; // frame age when handed to live555
+
     audio_stream(int devId, int aiChn, int aeChn)
         : devId(devId), aiChn(aiChn), aeChn(aeChn), running(false), imp_audio(nullptr),
           msgChannel(std::make_shared<MsgChannel<AudioFrame>>(30)),
-          onDataCallback{nullptr}, hasDataCallback{false}, base_timestamp(0), timestamp_initialized(false) {}
+          onDataCallback{nullptr}, hasDataCallback{false}, base_timestamp(0), timestamp_initialized(false),
+          send_latency(Metrics::instance().histogram("prudynt_capture_to_send_seconds",
+                                                     "Frame age when it is passed to the RTP sink.", metric_label("audio"))) {}
+
+    // wake the grabber thread after changing a condition it waits for
+    void wake()
+    {
+        std::lock_guard lck(mtx);
+        should_grab_frames.notify_all();
+    }
 };
 
 struct video_stream
@@ -104,16 +240,31 @@ struct video_stream
     pthread_t thread;
     bool idr;
     int idr_fix;
-    bool active{false};
+    std::atomic<bool> active{false};
     IMPEncoder *imp_encoder;
     IMPFramesource *imp_framesource;
-    std::shared_ptr<MsgChannel<H264NALUnit>> msgChannel;
-    std::function<void(void)> onDataCallback;
-    bool run_for_jpeg;                 // see comment in audio_stream
-    std::atomic<bool> hasDataCallback; // see comment in audio_stream
-    std::mutex onDataCallbackLock;     // protects onDataCallback from deallocation
-    std::condition_variable should_grab_frames;
-    std::binary_semaphore is_activated{0};
+    std::shared_ptr<BroadcastChannel<H264NALUnit>> msgChannel; // one reader per IMPDeviceSource
+    std::atomic<bool> run_for_jpeg;
+    std::atomic<bool> hasDataCallback; // msgChannel has readers, see comment in audio_stream
+    OrderedMutex mtx{LOCK_LEVEL_STREAM, "video_stream"}; // protects the should_grab_frames wait
+    std::condition_variable_any should_grab_frames; // also signals 'active' to the jpeg grabbers
+    std::atomic<int> pinned_streams{0}; // encoder streams referenced by queued NAL units
+    /* encoder streams not yet handed back, in IMP_Encoder_GetStream order,
+     * the encoder expects them back in that order */
+    struct held_stream
+    {
+        IMPEncoderStream stream;
+        bool pinned;
+    };
+    std::mutex held_mtx; // protects held_streams, no other lock is taken while holding it
+    std::condition_variable held_cv; // a pinned stream was handed back
+    std::deque<held_stream> held_streams;
+    std::atomic<bool> reconfigure{false}; // bitrate, gop or fps changed, see IMPEncoder::reconfigure()
+    std::atomic<int> source_fps{0}; // the encoder fps can be changed up to this without restart
+    std::atomic<int> bitrate{0}; // kbps the encoder runs with, published by the grabber for the RTSP thread
+    encoder_stats stats;
+    std::vector<std::shared_ptr<session_stats>> sessions; // one per IMPDeviceSource, protected by mtx
+    uint32_t next_session_id{1};                          // protected by mtx
     
     // Base timestamp for synchronizing streams - zero point reference
     int64_t base_timestamp{0};
@@ -121,20 +272,30 @@ struct video_stream
 
     video_stream(int encChn, _stream *stream, const char *name)
         : encChn(encChn), stream(stream), name(name), running(false), idr(false), idr_fix(0), imp_encoder(nullptr), imp_framesource(nullptr),
-          msgChannel(std::make_shared<MsgChannel<H264NALUnit>>(MSG_CHANNEL_SIZE)), onDataCallback(nullptr),  run_for_jpeg{false},
-          hasDataCallback{false}, base_timestamp(0), timestamp_initialized(false) {}
+          msgChannel(std::make_shared<BroadcastChannel<H264NALUnit>>(MSG_CHANNEL_SIZE)), run_for_jpeg{false},
+          hasDataCallback{false}, stats(name), base_timestamp(0), timestamp_initialized(false) {}
+
+    // wake the grabber thread after changing a condition it waits for
+    void wake()
+    {
+        std::lock_guard lck(mtx);
+        should_grab_frames.notify_all();
+    }
 };
 
-extern std::condition_variable global_cv_worker_restart;
+extern std::condition_variable_any global_cv_worker_restart;
 
-extern bool global_restart;
-extern bool global_restart_rtsp;
-extern bool global_restart_video;
-extern bool global_restart_audio;
+extern std::atomic<bool> global_restart;
+extern std::atomic<bool> global_restart_rtsp;
+extern std::atomic<bool> global_restart_video;
+extern std::atomic<bool> global_restart_audio;
 
 extern bool global_osd_thread_signal;
 extern bool global_main_thread_signal;
 extern bool global_motion_thread_signal;
+
+// motion is being detected, drives the OSD motion indicator
+extern std::atomic<bool> global_motion_indicator;
 extern std::atomic<char> global_rtsp_thread_signal;
 
 extern std::shared_ptr<jpeg_stream> global_jpeg[NUM_VIDEO_CHANNELS];
@@ -11,21 +11,23 @@
 #include "globals.hpp"
 #include "IMPSystem.hpp"
 #include "Motion.hpp"
+#include "Tracer.hpp"
 using namespace std::chrono;
 
-std::mutex mutex_main;
-std::condition_variable global_cv_worker_restart;
+OrderedMutex mutex_restart{LOCK_LEVEL_RESTART, "mutex_restart"};
+std::condition_variable_any global_cv_worker_restart;
 
 bool startup = true;
-bool global_restart = false;
+std::atomic<bool> global_restart{false};
 
-bool global_restart_rtsp = false;
-bool global_restart_video = false;
-bool global_restart_audio = false;
+std::atomic<bool> global_restart_rtsp{false};
+std::atomic<bool> global_restart_video{false};
+std::atomic<bool> global_restart_audio{false};
 
 bool global_osd_thread_signal = false;
 bool global_main_thread_signal = false;
 bool global_motion_thread_signal = false;
+std::atomic<bool> global_motion_indicator{false};
 std::atomic<char> global_rtsp_thread_signal{1};
 
 std::shared_ptr<jpeg_stream> global_jpeg[NUM_VIDEO_CHANNELS] = {nullptr};
@@ -67,6 +69,16 @@ void start_video(int encChn)
     sh.has_started.acquire();
 }
 
+void start_jpeg(int jpgChn)
+{
+    StartHelper sh{global_jpeg[jpgChn]->encChn};
+    int ret = pthread_create(&global_jpeg[jpgChn]->thread, nullptr, Worker::jpeg_grabber, static_cast<void *>(&sh));
+    LOG_DEBUG_OR_ERROR(ret, "create jpeg["<< jpgChn << "] thread");
+
+    // wait for initialization done
+    sh.has_started.acquire();
+}
+
 int main(int argc, const char *argv[])
 {
     LOG_INFO("PRUDYNT-T Next-Gen Video Daemon: " << VERSION);
@@ -95,10 +107,12 @@ int main(int argc, const char *argv[])
         imp_system = IMPSystem::createNew();
     }
 
+    Tracer::instance().enable(cfg->general.latency_trace);
+
     global_video[0] = std::make_shared<video_stream>(0, &cfg->stream0, "stream0");
     global_video[1] = std::make_shared<video_stream>(1, &cfg->stream1, "stream1");
-    global_jpeg[0] = std::make_shared<jpeg_stream>(2, &cfg->stream2);
-    //global_jpeg[1] = std::make_shared<jpeg_stream>(jpeg_stream{3, &cfg->stream3});
+    global_jpeg[0] = std::make_shared<jpeg_stream>(2, &cfg->stream2, "stream2");
+    global_jpeg[1] = std::make_shared<jpeg_stream>(3, &cfg->stream3, "stream3");
 
 #if defined(AUDIO_SUPPORT)
     global_audio[0] = std::make_shared<audio_stream>(1, 0, 0);
@@ -134,11 +148,12 @@ int main(int argc, const char *argv[])
 
             if (cfg->stream2.enabled)
             {
-                StartHelper sh{2};
-                int ret = pthread_create(&global_jpeg[0]->thread, nullptr, Worker::jpeg_grabber, static_cast<void *>(&sh));
-                LOG_DEBUG_OR_ERROR(ret, "create jpeg thread");
-                // wait for initialization done
-                sh.has_started.acquire();
+                start_jpeg(0);
+            }
+
+            if (cfg->stream3.enabled)
+            {
+                start_jpeg(1);
             }
 
             if (cfg->stream0.osd.enabled || cfg->stream1.osd.enabled)
@@ -168,7 +183,7 @@ int main(int argc, const char *argv[])
         usleep(250000 + (cfg->stream0.osd.start_delay * 1000) + cfg->stream1.osd.start_delay * 1000);
         
         LOG_DEBUG("main thread is going to sleep");
-        std::unique_lock lck(mutex_main);
+        std::unique_lock lck(mutex_restart);
         
         startup = false;
         global_restart = false;
@@ -177,7 +192,11 @@ int main(int argc, const char *argv[])
         global_restart_rtsp = false;        
         
         while (!global_restart_rtsp && !global_restart_video && !global_restart_audio)
-            global_cv_worker_restart.wait(lck);
+        {
+            // the 32 bit metric shards are widened before they can wrap around
+            if (global_cv_worker_restart.wait_for(lck, seconds(1)) == std::cv_status::timeout)
+                Metrics::instance().fold();
+        }
         lck.unlock();
 
         global_restart = true;
@@ -197,7 +216,7 @@ int main(int argc, const char *argv[])
         if (global_audio[0]->imp_audio && global_restart_audio)
         {
             global_audio[0]->running = false;
-            global_audio[0]->should_grab_frames.notify_one();
+            global_audio[0]->wake();
             int ret = pthread_join(global_audio[0]->thread, NULL);
             LOG_DEBUG_OR_ERROR(ret, "join audio thread");
         }
@@ -221,19 +240,22 @@ int main(int argc, const char *argv[])
             }
 
             // stop jpeg
-            if (global_jpeg[0]->imp_encoder)
+            for (auto &jpeg : global_jpeg)
             {
-                global_jpeg[0]->running = false;
-                global_jpeg[0]->should_grab_frames.notify_one();
-                int ret = pthread_join(global_jpeg[0]->thread, NULL);
-                LOG_DEBUG_OR_ERROR(ret, "join jpeg thread");
+                if (jpeg->imp_encoder)
+                {
+                    jpeg->running = false;
+                    jpeg->wake();
+                    int ret = pthread_join(jpeg->thread, NULL);
+                    LOG_DEBUG_OR_ERROR(ret, "join " << jpeg->name << " thread");
+                }
             }
 
             // stop stream1
             if (global_video[1]->imp_encoder)
             {
                 global_video[1]->running = false;
-                global_video[1]->should_grab_frames.notify_one();
+                global_video[1]->wake();
                 int ret = pthread_join(global_video[1]->thread, NULL);
                 LOG_DEBUG_OR_ERROR(ret, "join stream1 thread");
             }
@@ -242,7 +264,7 @@ int main(int argc, const char *argv[])
             if (global_video[0]->imp_encoder)
             {
                 global_video[0]->running = false;
-                global_video[0]->should_grab_frames.notify_one();
+                global_video[0]->wake();
                 int ret = pthread_join(global_video[0]->thread, NULL);
                 LOG_DEBUG_OR_ERROR(ret, "join stream0 thread");
             }
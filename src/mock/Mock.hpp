@@ -0,0 +1,59 @@
+#ifndef Mock_hpp
+#define Mock_hpp
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/* Host side stand-in for libimp and libsysutils, linked instead of the
+ * Ingenic libraries with make MOCK_IMP=1 (see ./build.sh mock). It is
+ * written against the T31 1.1.6 headers and replays recorded streams:
+ *
+ *   MOCK_IMP_H264      H.264 Annex B elementary stream for H264 channels
+ *   MOCK_IMP_H265      H.265 Annex B elementary stream for H265 channels
+ *   MOCK_IMP_JPEG      JPEG image returned by JPEG channels
+ *   MOCK_IMP_PCM       raw 16 bit mono PCM at the configured sample rate,
+ *                      a 1 kHz tone without it
+ *   MOCK_IMP_TIMEOUTS  percentage of polls which time out
+ *   MOCK_IMP_MOTION    report motion for 1 s every given seconds
+ *   MOCK_IMP_VERBOSE   log every call which changes state, 1 or 0
+ *
+ * Streams are looped and paced at the frame rate of the channel. A video
+ * channel without a stream never gets a frame, like a stalled encoder.
+ */
+
+#define MOCK_LOG(fmt, ...) fprintf(stderr, "[MOCK] " fmt "\n", ##__VA_ARGS__)
+#define MOCK_DEBUG(fmt, ...) do { if (mock_verbose()) MOCK_LOG(fmt, ##__VA_ARGS__); } while (0)
+
+const char *mock_env(const char *name);
+int mock_env_int(const char *name, int def);
+bool mock_verbose();
+
+// CLOCK_MONOTONIC in µs
+int64_t mock_now();
+
+// IMP timestamp of a CLOCK_MONOTONIC time point, see IMP_System_RebaseTimeStamp
+int64_t mock_timestamp(int64_t monotonic_us);
+
+// an input file, empty if name is not set or the file can't be read
+std::vector<uint8_t> mock_read_file(const char *name);
+
+/* Wait for an event due at the monotonic time due, but no longer than
+ * timeout_ms. Returns false on a (simulated) timeout.
+ */
+bool mock_poll(int64_t due, uint32_t timeout_ms);
+
+/* Memory below 4 GiB, the T31 encoder passes stream addresses as
+ * uint32_t which must survive the round trip on 64 bit hosts.
+ */
+void *mock_alloc32(size_t size);
+void mock_free32(void *ptr, size_t size);
+
+// frame rate of the sensor, paces the IVS
+uint32_t mock_sensor_fps();
+
+// OSD region statistics, logged on IMP_System_Exit
+void mock_osd_summary();
+
+#endif
@@ -0,0 +1,441 @@
+#include "Mock.hpp"
+#include <imp/imp_audio.h>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <cstring>
+#include <unistd.h>
+#include <algorithm>
+
+#define MOCK_AI_DEVICES 2
+#define MOCK_AENC_CHANNELS 2
+
+// handles of registered encoders start above the built in payload types
+#define MOCK_AENC_HANDLE_BASE 16
+
+struct MockInput
+{
+    std::mutex mtx;
+    IMPAudioIOAttr attr{};
+    bool enabled{false};
+    bool chn_enabled{false};
+    IMPAudioIChnParam param{};
+    int vol{60};
+    int gain{28};
+    std::vector<int16_t> pcm;   // replayed samples, a tone if empty
+    size_t pos{0};
+    std::vector<int16_t> frame;
+    int64_t due{INT64_MAX};
+    int seq{0};
+
+    int64_t interval() const
+    {
+        return attr.samplerate ? 1000000LL * attr.numPerFrm / attr.samplerate : 40000;
+    }
+};
+
+struct MockAenc
+{
+    std::mutex mtx;
+    bool created{false};
+    IMPAudioPalyloadType type{PT_PCM};
+    IMPAudioEncEncoder *encoder{nullptr};
+    std::vector<uint8_t> out;
+    int64_t timestamp{0};
+    int seq{0};
+    bool ready{false};
+};
+
+static MockInput inputs[MOCK_AI_DEVICES];
+static MockAenc aencs[MOCK_AENC_CHANNELS];
+static std::mutex encoders_mtx;
+static std::deque<IMPAudioEncEncoder> encoders; // no reallocation, channels point into it
+
+static MockInput *input(int audioDevId)
+{
+    return audioDevId >= 0 && audioDevId < MOCK_AI_DEVICES ? &inputs[audioDevId] : nullptr;
+}
+
+static MockAenc *aenc(int aeChn)
+{
+    return aeChn >= 0 && aeChn < MOCK_AENC_CHANNELS && aencs[aeChn].created ? &aencs[aeChn] : nullptr;
+}
+
+/* G.711 from the ITU reference, the SDK encodes these itself */
+
+static uint8_t linear_to_alaw(int16_t pcm)
+{
+    int mask = pcm >= 0 ? 0xd5 : 0x55;
+    int value = pcm >= 0 ? pcm >> 3 : (~pcm) >> 3;
+    int seg = 0;
+    while (seg < 8 && value >= (0x20 << seg))
+        seg++;
+    if (seg >= 8)
+        return 0x7f ^ mask;
+    int aval = seg << 4;
+    aval |= seg < 2 ? (value >> 1) & 0x0f : (value >> seg) & 0x0f;
+    return aval ^ mask;
+}
+
+static uint8_t linear_to_ulaw(int16_t pcm)
+{
+    int value = pcm >> 2;
+    int mask = 0xff;
+    if (value < 0)
+    {
+        value = -value;
+        mask = 0x7f;
+    }
+    value = std::min(value, 8159) + 0x21;
+    int seg = 0;
+    while (seg < 8 && value >= (0x40 << seg))
+        seg++;
+    if (seg >= 8)
+        return 0x7f ^ mask;
+    return ((seg << 4) | ((value >> (seg + 1)) & 0x0f)) ^ mask;
+}
+
+/* input */
+
+int IMP_AI_SetPubAttr(int audioDevId, IMPAudioIOAttr *attr)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+
+    std::lock_guard lock{in->mtx};
+    in->attr = *attr;
+    MOCK_DEBUG("IMP_AI_SetPubAttr(%d) %d Hz, %d samples per frame", audioDevId, attr->samplerate, attr->numPerFrm);
+    return 0;
+}
+
+int IMP_AI_GetPubAttr(int audioDevId, IMPAudioIOAttr *attr)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+
+    std::lock_guard lock{in->mtx};
+    *attr = in->attr;
+    return 0;
+}
+
+int IMP_AI_Enable(int audioDevId)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+
+    std::vector<uint8_t> data = mock_read_file("MOCK_IMP_PCM");
+    std::lock_guard lock{in->mtx};
+    in->pcm.resize(data.size() / sizeof(int16_t));
+    memcpy(in->pcm.data(), data.data(), in->pcm.size() * sizeof(int16_t));
+    in->pos = 0;
+    in->enabled = true;
+    return 0;
+}
+
+int IMP_AI_Disable(int audioDevId)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+
+    std::lock_guard lock{in->mtx};
+    in->enabled = false;
+    in->pcm.clear();
+    return 0;
+}
+
+int IMP_AI_EnableChn(int audioDevId, int aiChn)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+
+    std::lock_guard lock{in->mtx};
+    in->chn_enabled = true;
+    in->frame.resize(in->attr.numPerFrm);
+    in->due = mock_now() + in->interval();
+    return 0;
+}
+
+int IMP_AI_DisableChn(int audioDevId, int aiChn)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+
+    std::lock_guard lock{in->mtx};
+    in->chn_enabled = false;
+    in->due = INT64_MAX;
+    return 0;
+}
+
+int IMP_AI_SetChnParam(int audioDevId, int aiChn, IMPAudioIChnParam *chnParam)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+    in->param = *chnParam;
+    return 0;
+}
+
+int IMP_AI_GetChnParam(int audioDevId, int aiChn, IMPAudioIChnParam *chnParam)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+    *chnParam = in->param;
+    return 0;
+}
+
+int IMP_AI_SetVol(int audioDevId, int aiChn, int aiVol)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+    in->vol = aiVol;
+    return 0;
+}
+
+int IMP_AI_GetVol(int audioDevId, int aiChn, int *vol)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+    *vol = in->vol;
+    return 0;
+}
+
+int IMP_AI_SetGain(int audioDevId, int aiChn, int aiGain)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+    in->gain = aiGain;
+    return 0;
+}
+
+int IMP_AI_GetGain(int audioDevId, int aiChn, int *aiGain)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+    *aiGain = in->gain;
+    return 0;
+}
+
+int IMP_AI_SetAlcGain(int audioDevId, int aiChn, int aiPgaGain) { return 0; }
+int IMP_AI_EnableNs(IMPAudioIOAttr *attr, int mode) { return 0; }
+int IMP_AI_DisableNs(void) { return 0; }
+int IMP_AI_EnableHpf(IMPAudioIOAttr *attr) { return 0; }
+int IMP_AI_DisableHpf(void) { return 0; }
+int IMP_AI_EnableAgc(IMPAudioIOAttr *attr, IMPAudioAgcConfig agcConfig) { return 0; }
+int IMP_AI_DisableAgc(void) { return 0; }
+
+int IMP_AI_PollingFrame(int audioDevId, int aiChn, unsigned int timeout_ms)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+
+    int64_t due;
+    {
+        std::lock_guard lock{in->mtx};
+        int64_t now = mock_now();
+        if (in->due != INT64_MAX && in->due < now - 1000000)
+            in->due = now;
+        due = in->due;
+    }
+    return mock_poll(due, timeout_ms) ? 0 : -1;
+}
+
+int IMP_AI_GetFrame(int audioDevId, int aiChn, IMPAudioFrame *frm, IMPBlock block)
+{
+    MockInput *in = input(audioDevId);
+    if (!in)
+        return -1;
+
+    std::unique_lock lock{in->mtx};
+    if (!in->chn_enabled || in->frame.empty())
+        return -1;
+
+    int64_t due = in->due;
+    int64_t wait = due - mock_now();
+    if (wait > 0)
+    {
+        if (block == NOBLOCK)
+            return -1;
+        lock.unlock();
+        usleep(wait);
+        lock.lock();
+    }
+
+    for (auto &sample : in->frame)
+    {
+        if (!in->pcm.empty())
+        {
+            sample = in->pcm[in->pos];
+            in->pos = (in->pos + 1) % in->pcm.size();
+        }
+        else
+        {
+            // 1 kHz at -20 dBFS, silence would let the encoders idle
+            sample = (int16_t)(3276 * sin(2 * M_PI * 1000 * in->pos / (int)in->attr.samplerate));
+            in->pos = (in->pos + 1) % in->attr.samplerate;
+        }
+    }
+
+    memset(frm, 0, sizeof(*frm));
+    frm->bitwidth = in->attr.bitwidth;
+    frm->soundmode = in->attr.soundmode;
+    frm->virAddr = (uint32_t *)in->frame.data();
+    frm->timeStamp = mock_timestamp(due);
+    frm->seq = in->seq++;
+    frm->len = in->frame.size() * sizeof(int16_t);
+
+    in->due = due + in->interval();
+    return 0;
+}
+
+int IMP_AI_ReleaseFrame(int audioDevId, int aiChn, IMPAudioFrame *frm)
+{
+    return input(audioDevId) ? 0 : -1;
+}
+
+/* encoder */
+
+int IMP_AENC_RegisterEncoder(int *handle, IMPAudioEncEncoder *encoder)
+{
+    std::lock_guard lock{encoders_mtx};
+    encoders.push_back(*encoder);
+    *handle = MOCK_AENC_HANDLE_BASE + encoders.size() - 1;
+    MOCK_DEBUG("IMP_AENC_RegisterEncoder(%s) = %d", encoder->name, *handle);
+    return 0;
+}
+
+int IMP_AENC_UnRegisterEncoder(int *handle)
+{
+    std::lock_guard lock{encoders_mtx};
+    size_t idx = *handle - MOCK_AENC_HANDLE_BASE;
+    if (*handle < MOCK_AENC_HANDLE_BASE || idx >= encoders.size())
+        return -1;
+    // keep the indexes of the others, the slot is not reused
+    memset(&encoders[idx], 0, sizeof(IMPAudioEncEncoder));
+    return 0;
+}
+
+int IMP_AENC_CreateChn(int aeChn, IMPAudioEncChnAttr *attr)
+{
+    if (aeChn < 0 || aeChn >= MOCK_AENC_CHANNELS)
+        return -1;
+
+    MockAenc &enc = aencs[aeChn];
+    std::lock_guard lock{enc.mtx};
+    enc.type = attr->type;
+    enc.encoder = nullptr;
+    if (attr->type >= MOCK_AENC_HANDLE_BASE)
+    {
+        std::lock_guard lock_encoders{encoders_mtx};
+        size_t idx = attr->type - MOCK_AENC_HANDLE_BASE;
+        if (idx >= encoders.size() || !encoders[idx].encoderFrm)
+            return -1;
+        enc.encoder = &encoders[idx];
+        if (enc.encoder->openEncoder && enc.encoder->openEncoder(attr, nullptr) != 0)
+            return -1;
+    }
+    enc.created = true;
+    enc.ready = false;
+    return 0;
+}
+
+int IMP_AENC_DestroyChn(int aeChn)
+{
+    MockAenc *enc = aenc(aeChn);
+    if (!enc)
+        return -1;
+
+    std::lock_guard lock{enc->mtx};
+    if (enc->encoder && enc->encoder->closeEncoder)
+        enc->encoder->closeEncoder(nullptr);
+    enc->encoder = nullptr;
+    enc->created = false;
+    return 0;
+}
+
+int IMP_AENC_SendFrame(int aeChn, IMPAudioFrame *frm)
+{
+    MockAenc *enc = aenc(aeChn);
+    if (!enc)
+        return -1;
+
+    std::lock_guard lock{enc->mtx};
+    const int16_t *pcm = (const int16_t *)frm->virAddr;
+    size_t samples = frm->len / sizeof(int16_t);
+
+    if (enc->encoder)
+    {
+        enc->out.resize(std::max(enc->encoder->maxFrmLen, frm->len));
+        int len = 0;
+        if (enc->encoder->encoderFrm(nullptr, frm, enc->out.data(), &len) != 0)
+            return -1;
+        enc->out.resize(len);
+    }
+    else if (enc->type == PT_G711A || enc->type == PT_G711U)
+    {
+        enc->out.resize(samples);
+        for (size_t i = 0; i < samples; i++)
+            enc->out[i] = enc->type == PT_G711A ? linear_to_alaw(pcm[i]) : linear_to_ulaw(pcm[i]);
+    }
+    else
+    {
+        // G.726 is not emulated, the frame has the size of 16 kbit/s but is silent
+        enc->out.assign(samples / 4, 0);
+    }
+
+    enc->timestamp = frm->timeStamp;
+    enc->seq = frm->seq;
+    enc->ready = true;
+    return 0;
+}
+
+int IMP_AENC_PollingStream(int AeChn, unsigned int timeout_ms)
+{
+    MockAenc *enc = aenc(AeChn);
+    if (!enc)
+        return -1;
+
+    // the frame is encoded by SendFrame already
+    std::lock_guard lock{enc->mtx};
+    return enc->ready ? 0 : -1;
+}
+
+int IMP_AENC_GetStream(int aeChn, IMPAudioStream *stream, IMPBlock block)
+{
+    MockAenc *enc = aenc(aeChn);
+    if (!enc)
+        return -1;
+
+    std::lock_guard lock{enc->mtx};
+    if (!enc->ready)
+        return -1;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->stream = enc->out.data();
+    stream->len = enc->out.size();
+    stream->timeStamp = enc->timestamp;
+    stream->seq = enc->seq;
+    return 0;
+}
+
+int IMP_AENC_ReleaseStream(int aeChn, IMPAudioStream *stream)
+{
+    MockAenc *enc = aenc(aeChn);
+    if (!enc)
+        return -1;
+
+    std::lock_guard lock{enc->mtx};
+    enc->ready = false;
+    return 0;
+}
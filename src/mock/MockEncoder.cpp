@@ -0,0 +1,482 @@
+#include "Mock.hpp"
+#include <imp/imp_encoder.h>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <cstring>
+#include <unistd.h>
+
+#define MOCK_ENC_CHANNELS 4
+
+/* An elementary stream split into access units. The NAL units are copied
+ * with 4 byte start codes, which the encoder always emits and the worker
+ * relies on, into memory addressable by the uint32_t stream address.
+ */
+struct MockStream
+{
+    struct Nal
+    {
+        uint32_t offset; // from the start of the access unit, start code included
+        uint32_t length;
+        uint8_t type;
+    };
+
+    struct AccessUnit
+    {
+        uint32_t offset;
+        uint32_t size;
+        bool irap;
+        std::vector<Nal> nals;
+    };
+
+    uint8_t *data{nullptr};
+    size_t capacity{0};
+    std::vector<AccessUnit> aus;
+
+    ~MockStream() { mock_free32(data, capacity); }
+    bool load(const std::vector<uint8_t> &es, bool h265);
+    bool load_jpeg(const std::vector<uint8_t> &jpeg);
+};
+
+struct MockChannel
+{
+    std::mutex mtx;
+    bool created{false};
+    int group{-1};
+    bool receiving{false};
+    IMPEncoderChnAttr attr{};
+    std::shared_ptr<MockStream> stream;
+    size_t next{0};             // next access unit
+    int64_t due{INT64_MAX};     // CLOCK_MONOTONIC of the next frame
+    uint32_t seq{0};
+    std::map<uint32_t, IMPEncoderPack *> out; // streams not released yet, by seq
+
+    int64_t interval() const
+    {
+        const IMPEncoderFrmRate &rate = attr.rcAttr.outFrmRate;
+        return rate.frmRateNum ? 1000000LL * (rate.frmRateDen ? rate.frmRateDen : 1) / rate.frmRateNum : 40000;
+    }
+};
+
+static MockChannel channels[MOCK_ENC_CHANNELS];
+
+static size_t find_start_code(const std::vector<uint8_t> &es, size_t pos, size_t *len)
+{
+    for (; pos + 3 <= es.size(); pos++)
+    {
+        if (es[pos] == 0 && es[pos + 1] == 0 && es[pos + 2] == 1)
+        {
+            *len = 3;
+            return pos;
+        }
+    }
+    *len = 0;
+    return es.size();
+}
+
+bool MockStream::load(const std::vector<uint8_t> &es, bool h265)
+{
+    size_t sc_len;
+    size_t pos = find_start_code(es, 0, &sc_len);
+
+    // every NAL unit grows by at most one byte, its start code becomes 4 bytes
+    capacity = es.size() + es.size() / 3 + 4;
+    data = (uint8_t *)mock_alloc32(capacity);
+    if (!data)
+        return false;
+
+    size_t size = 0;
+    bool vcl_seen = false;
+    while (pos < es.size())
+    {
+        size_t begin = pos + sc_len;
+        size_t next_len;
+        size_t end = find_start_code(es, begin, &next_len);
+        size_t next = end;
+        // zero bytes in front of the next start code belong to it
+        while (end > begin && es[end - 1] == 0)
+            end--;
+        pos = next;
+        sc_len = next_len;
+        if (end <= begin)
+            continue;
+
+        const uint8_t *nal = &es[begin];
+        size_t nal_len = end - begin;
+        uint8_t type = h265 ? (nal[0] >> 1) & 0x3f : nal[0] & 0x1f;
+        bool vcl = h265 ? type < 32 : (type >= 1 && type <= 5);
+        // first slice of a picture, first_mb_in_slice 0 or first_slice_segment_in_pic_flag
+        bool first_slice = vcl && nal_len > (h265 ? 2u : 1u) && (h265 ? (nal[2] & 0x80) : (nal[1] & 0x80));
+        // the suffix SEI and end of sequence/bitstream still belong to the current access unit
+        bool suffix = h265 ? (type == 36 || type == 37 || type == 40) : (type == 10 || type == 11);
+
+        if (aus.empty() || (vcl_seen && ((!vcl && !suffix) || first_slice)))
+        {
+            aus.push_back({(uint32_t)size, 0, false, {}});
+            vcl_seen = false;
+        }
+
+        AccessUnit &au = aus.back();
+        static const uint8_t start_code[] = {0, 0, 0, 1};
+        memcpy(data + size, start_code, 4);
+        memcpy(data + size + 4, nal, nal_len);
+        au.nals.push_back({(uint32_t)(size - au.offset), (uint32_t)(nal_len + 4), type});
+        size += nal_len + 4;
+        au.size = size - au.offset;
+        au.irap |= h265 ? (type >= 16 && type <= 23) : type == 5;
+        vcl_seen |= vcl;
+    }
+
+    // access units without a picture can't be paced
+    std::erase_if(aus, [h265](const AccessUnit &au) {
+        for (auto &nal : au.nals)
+            if (h265 ? nal.type < 32 : (nal.type >= 1 && nal.type <= 5))
+                return false;
+        return true;
+    });
+    return !aus.empty();
+}
+
+bool MockStream::load_jpeg(const std::vector<uint8_t> &jpeg)
+{
+    capacity = jpeg.size();
+    data = (uint8_t *)mock_alloc32(capacity);
+    if (!data)
+        return false;
+    memcpy(data, jpeg.data(), jpeg.size());
+    aus.push_back({0, (uint32_t)jpeg.size(), true, {{0, (uint32_t)jpeg.size(), 0}}});
+    return true;
+}
+
+static std::shared_ptr<MockStream> load_stream(IMPEncoderProfile profile)
+{
+    // channels with the same format share the replayed stream
+    static std::mutex mtx;
+    static std::map<int, std::weak_ptr<MockStream>> loaded;
+
+    std::lock_guard lock{mtx};
+    if (auto stream = loaded[profile].lock())
+        return stream;
+
+    const char *name = profile == IMP_ENC_PROFILE_JPEG ? "MOCK_IMP_JPEG" :
+                       profile == IMP_ENC_PROFILE_HEVC_MAIN ? "MOCK_IMP_H265" : "MOCK_IMP_H264";
+    std::vector<uint8_t> input = mock_read_file(name);
+    if (input.empty())
+    {
+        MOCK_LOG("%s not set, the channel produces no frames", name);
+        return nullptr;
+    }
+
+    auto stream = std::make_shared<MockStream>();
+    bool ok = profile == IMP_ENC_PROFILE_JPEG ? stream->load_jpeg(input)
+                                              : stream->load(input, profile == IMP_ENC_PROFILE_HEVC_MAIN);
+    if (!ok)
+    {
+        MOCK_LOG("%s: no frames", name);
+        return nullptr;
+    }
+    MOCK_LOG("%s: %zu frames", name, stream->aus.size());
+    loaded[profile] = stream;
+    return stream;
+}
+
+static MockChannel *channel(int encChn)
+{
+    if (encChn < 0 || encChn >= MOCK_ENC_CHANNELS || !channels[encChn].created)
+        return nullptr;
+    return &channels[encChn];
+}
+
+int IMP_Encoder_CreateGroup(int encGroup) { return 0; }
+int IMP_Encoder_DestroyGroup(int encGroup) { return 0; }
+
+int IMP_Encoder_SetDefaultParam(IMPEncoderChnAttr *chnAttr, IMPEncoderProfile profile, IMPEncoderRcMode rcMode,
+                                uint16_t uWidth, uint16_t uHeight, uint32_t frmRateNum, uint32_t frmRateDen,
+                                uint32_t uGopLength, int uMaxSameSenceCnt, int iInitialQP, uint32_t uTargetBitRate)
+{
+    memset(chnAttr, 0, sizeof(*chnAttr));
+    chnAttr->encAttr.eProfile = profile;
+    chnAttr->encAttr.uWidth = uWidth;
+    chnAttr->encAttr.uHeight = uHeight;
+    chnAttr->rcAttr.attrRcMode.rcMode = rcMode;
+    chnAttr->rcAttr.outFrmRate.frmRateNum = frmRateNum;
+    chnAttr->rcAttr.outFrmRate.frmRateDen = frmRateDen;
+    chnAttr->gopAttr.uGopLength = uGopLength;
+    return 0;
+}
+
+int IMP_Encoder_CreateChn(int encChn, const IMPEncoderChnAttr *attr)
+{
+    if (encChn < 0 || encChn >= MOCK_ENC_CHANNELS)
+        return -1;
+
+    MockChannel &chn = channels[encChn];
+    std::lock_guard lock{chn.mtx};
+    chn.attr = *attr;
+    chn.stream = load_stream(attr->encAttr.eProfile);
+    chn.next = 0;
+    chn.created = true;
+    MOCK_DEBUG("IMP_Encoder_CreateChn(%d) profile %d, %ux%u", encChn, attr->encAttr.eProfile,
+               attr->encAttr.uWidth, attr->encAttr.uHeight);
+    return 0;
+}
+
+int IMP_Encoder_DestroyChn(int encChn)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    if (!chn->out.empty())
+        MOCK_LOG("IMP_Encoder_DestroyChn(%d) with %zu streams not released", encChn, chn->out.size());
+    for (auto &out : chn->out)
+        delete[] out.second;
+    chn->out.clear();
+    chn->stream.reset();
+    chn->created = false;
+    return 0;
+}
+
+int IMP_Encoder_GetChnAttr(int encChn, IMPEncoderChnAttr *const attr)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    *attr = chn->attr;
+    return 0;
+}
+
+int IMP_Encoder_RegisterChn(int encGroup, int encChn)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+    chn->group = encGroup;
+    return 0;
+}
+
+int IMP_Encoder_UnRegisterChn(int encChn)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+    chn->group = -1;
+    return 0;
+}
+
+int IMP_Encoder_StartRecvPic(int encChn)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    chn->receiving = true;
+    chn->due = chn->stream ? mock_now() + chn->interval() : INT64_MAX;
+    return 0;
+}
+
+int IMP_Encoder_StopRecvPic(int encChn)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    chn->receiving = false;
+    chn->due = INT64_MAX;
+    return 0;
+}
+
+int IMP_Encoder_PollingStream(int encChn, uint32_t timeoutMsec)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    int64_t due;
+    {
+        std::lock_guard lock{chn->mtx};
+        // the encoder doesn't queue more than a second while nobody reads
+        int64_t now = mock_now();
+        if (chn->due != INT64_MAX && chn->due < now - 1000000)
+            chn->due = now;
+        due = chn->due;
+    }
+    return mock_poll(due, timeoutMsec) ? 0 : -1;
+}
+
+int IMP_Encoder_GetStream(int encChn, IMPEncoderStream *stream, bool blockFlag)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::unique_lock lock{chn->mtx};
+    if (!chn->receiving || !chn->stream)
+        return -1;
+
+    int64_t due = chn->due;
+    int64_t wait = due - mock_now();
+    if (wait > 0)
+    {
+        if (!blockFlag)
+            return -1;
+        lock.unlock();
+        usleep(wait);
+        lock.lock();
+        if (!chn->receiving || !chn->stream)
+            return -1;
+    }
+
+    const MockStream::AccessUnit &au = chn->stream->aus[chn->next];
+    IMPEncoderPack *packs = new IMPEncoderPack[au.nals.size()]();
+    for (size_t i = 0; i < au.nals.size(); i++)
+    {
+        packs[i].offset = au.nals[i].offset;
+        packs[i].length = au.nals[i].length;
+        packs[i].timestamp = mock_timestamp(due);
+        packs[i].frameEnd = i == au.nals.size() - 1;
+        // the pack types are numbered like the NAL unit types
+        if (chn->attr.encAttr.eProfile == IMP_ENC_PROFILE_HEVC_MAIN)
+            packs[i].nalType.h265NalType = (IMPEncoderH265NaluType)au.nals[i].type;
+        else
+            packs[i].nalType.h264NalType = (IMPEncoderH264NaluType)au.nals[i].type;
+    }
+
+    memset(stream, 0, sizeof(*stream));
+    stream->virAddr = (uint32_t)(uintptr_t)(chn->stream->data + au.offset);
+    stream->phyAddr = stream->virAddr;
+    stream->streamSize = au.size;
+    stream->pack = packs;
+    stream->packCount = au.nals.size();
+    stream->seq = chn->seq++;
+    chn->out[stream->seq] = packs;
+
+    chn->next = (chn->next + 1) % chn->stream->aus.size();
+    chn->due = due + chn->interval();
+    return 0;
+}
+
+int IMP_Encoder_ReleaseStream(int encChn, IMPEncoderStream *stream)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    auto it = chn->out.find(stream->seq);
+    if (it == chn->out.end())
+    {
+        MOCK_LOG("IMP_Encoder_ReleaseStream(%d) of unknown stream %u", encChn, stream->seq);
+        return -1;
+    }
+    delete[] it->second;
+    chn->out.erase(it);
+    return 0;
+}
+
+int IMP_Encoder_Query(int encChn, IMPEncoderChnStat *stat)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    memset(stat, 0, sizeof(*stat));
+    stat->registered = chn->group >= 0;
+    stat->leftPics = 0;
+    stat->leftStreamFrames = chn->out.size();
+    stat->work_done = 1;
+    return 0;
+}
+
+int IMP_Encoder_RequestIDR(int encChn)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    // continue with the next IDR, a recorded stream can't start a new one
+    std::lock_guard lock{chn->mtx};
+    if (chn->stream)
+    {
+        size_t count = chn->stream->aus.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t au = (chn->next + i) % count;
+            if (chn->stream->aus[au].irap)
+            {
+                chn->next = au;
+                break;
+            }
+        }
+    }
+    MOCK_DEBUG("IMP_Encoder_RequestIDR(%d)", encChn);
+    return 0;
+}
+
+int IMP_Encoder_FlushStream(int encChn)
+{
+    return IMP_Encoder_RequestIDR(encChn);
+}
+
+int IMP_Encoder_SetChnFrmRate(int encChn, const IMPEncoderFrmRate *pstFps)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    chn->attr.rcAttr.outFrmRate = *pstFps;
+    MOCK_DEBUG("IMP_Encoder_SetChnFrmRate(%d, %u/%u)", encChn, pstFps->frmRateNum, pstFps->frmRateDen);
+    return 0;
+}
+
+int IMP_Encoder_SetChnBitRate(int encChn, int iTargetBitRate, int iMaxBitRate)
+{
+    // the replayed stream keeps its bitrate
+    MOCK_DEBUG("IMP_Encoder_SetChnBitRate(%d, %d, %d)", encChn, iTargetBitRate, iMaxBitRate);
+    return channel(encChn) ? 0 : -1;
+}
+
+int IMP_Encoder_SetChnGopLength(int encChn, int iGopLength)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    chn->attr.gopAttr.uGopLength = iGopLength;
+    MOCK_DEBUG("IMP_Encoder_SetChnGopLength(%d, %d)", encChn, iGopLength);
+    return 0;
+}
+
+int IMP_Encoder_GetChnAttrRcMode(int encChn, IMPEncoderAttrRcMode *pstRcModeCfg)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    *pstRcModeCfg = chn->attr.rcAttr.attrRcMode;
+    return 0;
+}
+
+int IMP_Encoder_SetChnAttrRcMode(int encChn, const IMPEncoderAttrRcMode *pstRcModeCfg)
+{
+    MockChannel *chn = channel(encChn);
+    if (!chn)
+        return -1;
+
+    std::lock_guard lock{chn->mtx};
+    chn->attr.rcAttr.attrRcMode = *pstRcModeCfg;
+    return 0;
+}
+
+int IMP_Encoder_SetbufshareChn(int encChn, int shareChn) { return 0; }
+int IMP_Encoder_SetJpegeQl(int encChn, const IMPEncoderJpegeQl *pstJpegeQl) { return 0; }
+int IMP_Encoder_SetFisheyeEnableStatus(int encChn, int enable) { return 0; }
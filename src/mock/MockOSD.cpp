@@ -0,0 +1,252 @@
+#include "Mock.hpp"
+#include <imp/imp_osd.h>
+#include <imp/imp_ivs.h>
+#include <imp/imp_ivs_move.h>
+#include <map>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#define MOCK_OSD_GROUPS 4
+#define MOCK_IVS_CHANNELS 4
+
+/* OSD regions are recorded, not drawn: every update is counted and with
+ * MOCK_IMP_VERBOSE=1 logged with a hash of the bitmap, so redundant
+ * updates show up.
+ */
+struct MockRegion
+{
+    IMPOSDRgnAttr attr{};
+    IMPOSDGrpRgnAttr grp[MOCK_OSD_GROUPS]{};
+    bool registered[MOCK_OSD_GROUPS]{};
+    uint64_t updates{0};
+    uint64_t bytes{0};
+};
+
+static std::mutex osd_mtx;
+static std::map<IMPRgnHandle, MockRegion> regions;
+static IMPRgnHandle next_region = 0;
+
+static IMP_IVS_MoveParam move_params[MOCK_IVS_CHANNELS];
+static IMP_IVS_MoveOutput move_output[MOCK_IVS_CHANNELS];
+
+static size_t bitmap_size(const IMPOSDRgnAttr &attr)
+{
+    if (attr.type != OSD_REG_PIC && attr.type != OSD_REG_BITMAP)
+        return 0;
+    int width = attr.rect.p1.x - attr.rect.p0.x + 1;
+    int height = attr.rect.p1.y - attr.rect.p0.y + 1;
+    return width > 0 && height > 0 ? (size_t)width * height * 4 : 0;
+}
+
+// FNV-1a
+static uint32_t bitmap_hash(const void *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; data && i < size; i++)
+    {
+        hash ^= ((const uint8_t *)data)[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void record_update(IMPRgnHandle handle, MockRegion &rgn, const IMPOSDRgnAttrData &data)
+{
+    size_t size = bitmap_size(rgn.attr);
+    rgn.updates++;
+    rgn.bytes += size;
+    MOCK_DEBUG("osd region %d update %llu, %dx%d, hash %08x", handle, (unsigned long long)rgn.updates,
+               rgn.attr.rect.p1.x - rgn.attr.rect.p0.x + 1, rgn.attr.rect.p1.y - rgn.attr.rect.p0.y + 1,
+               size ? bitmap_hash(data.picData.pData, size) : 0);
+}
+
+void mock_osd_summary()
+{
+    std::lock_guard lock{osd_mtx};
+    for (auto &r : regions)
+    {
+        MOCK_LOG("osd region %d: %llu updates, %llu bytes", r.first, (unsigned long long)r.second.updates,
+                 (unsigned long long)r.second.bytes);
+    }
+}
+
+int IMP_OSD_SetPoolSize(int size) { return 0; }
+int IMP_OSD_CreateGroup(int grpNum) { return grpNum >= 0 && grpNum < MOCK_OSD_GROUPS ? 0 : -1; }
+int IMP_OSD_DestroyGroup(int grpNum) { return 0; }
+int IMP_OSD_Start(int grpNum) { return 0; }
+int IMP_OSD_Stop(int grpNum) { return 0; }
+
+IMPRgnHandle IMP_OSD_CreateRgn(IMPOSDRgnAttr *prAttr)
+{
+    std::lock_guard lock{osd_mtx};
+    IMPRgnHandle handle = next_region++;
+    if (prAttr)
+        regions[handle].attr = *prAttr;
+    else
+        regions[handle];
+    return handle;
+}
+
+void IMP_OSD_DestroyRgn(IMPRgnHandle handle)
+{
+    std::lock_guard lock{osd_mtx};
+    regions.erase(handle);
+}
+
+int IMP_OSD_RegisterRgn(IMPRgnHandle handle, int grpNum, IMPOSDGrpRgnAttr *pgrAttr)
+{
+    std::lock_guard lock{osd_mtx};
+    auto it = regions.find(handle);
+    if (it == regions.end() || grpNum < 0 || grpNum >= MOCK_OSD_GROUPS)
+        return -1;
+    it->second.registered[grpNum] = true;
+    if (pgrAttr)
+        it->second.grp[grpNum] = *pgrAttr;
+    return 0;
+}
+
+int IMP_OSD_UnRegisterRgn(IMPRgnHandle handle, int grpNum)
+{
+    std::lock_guard lock{osd_mtx};
+    auto it = regions.find(handle);
+    if (it == regions.end() || grpNum < 0 || grpNum >= MOCK_OSD_GROUPS)
+        return -1;
+    it->second.registered[grpNum] = false;
+    return 0;
+}
+
+int IMP_OSD_SetRgnAttr(IMPRgnHandle handle, IMPOSDRgnAttr *prAttr)
+{
+    std::lock_guard lock{osd_mtx};
+    auto it = regions.find(handle);
+    if (it == regions.end())
+        return -1;
+    it->second.attr = *prAttr;
+    record_update(handle, it->second, prAttr->data);
+    return 0;
+}
+
+int IMP_OSD_GetRgnAttr(IMPRgnHandle handle, IMPOSDRgnAttr *prAttr)
+{
+    std::lock_guard lock{osd_mtx};
+    auto it = regions.find(handle);
+    if (it == regions.end())
+        return -1;
+    *prAttr = it->second.attr;
+    return 0;
+}
+
+int IMP_OSD_UpdateRgnAttrData(IMPRgnHandle handle, IMPOSDRgnAttrData *prAttrData)
+{
+    std::lock_guard lock{osd_mtx};
+    auto it = regions.find(handle);
+    if (it == regions.end())
+        return -1;
+    it->second.attr.data = *prAttrData;
+    record_update(handle, it->second, *prAttrData);
+    return 0;
+}
+
+int IMP_OSD_SetGrpRgnAttr(IMPRgnHandle handle, int grpNum, IMPOSDGrpRgnAttr *pgrAttr)
+{
+    std::lock_guard lock{osd_mtx};
+    auto it = regions.find(handle);
+    if (it == regions.end() || grpNum < 0 || grpNum >= MOCK_OSD_GROUPS)
+        return -1;
+    it->second.grp[grpNum] = *pgrAttr;
+    return 0;
+}
+
+int IMP_OSD_GetGrpRgnAttr(IMPRgnHandle handle, int grpNum, IMPOSDGrpRgnAttr *pgrAttr)
+{
+    std::lock_guard lock{osd_mtx};
+    auto it = regions.find(handle);
+    if (it == regions.end() || grpNum < 0 || grpNum >= MOCK_OSD_GROUPS)
+        return -1;
+    *pgrAttr = it->second.grp[grpNum];
+    return 0;
+}
+
+int IMP_OSD_ShowRgn(IMPRgnHandle handle, int grpNum, int showFlag)
+{
+    std::lock_guard lock{osd_mtx};
+    auto it = regions.find(handle);
+    if (it == regions.end() || grpNum < 0 || grpNum >= MOCK_OSD_GROUPS)
+        return -1;
+    it->second.grp[grpNum].show = showFlag;
+    MOCK_DEBUG("osd region %d %s in group %d", handle, showFlag ? "shown" : "hidden", grpNum);
+    return 0;
+}
+
+/* ivs, motion detection reports no motion unless MOCK_IMP_MOTION is set */
+
+IMPIVSInterface *IMP_IVS_CreateMoveInterface(IMP_IVS_MoveParam *param)
+{
+    IMPIVSInterface *intf = (IMPIVSInterface *)calloc(1, sizeof(IMPIVSInterface) + sizeof(IMP_IVS_MoveParam));
+    if (intf)
+    {
+        // the parameters follow the interface, like the SDK keeps them
+        memcpy(intf + 1, param, sizeof(IMP_IVS_MoveParam));
+        intf->param = intf + 1;
+        intf->paramSize = sizeof(IMP_IVS_MoveParam);
+    }
+    return intf;
+}
+
+void IMP_IVS_DestroyMoveInterface(IMPIVSInterface *moveInterface)
+{
+    free(moveInterface);
+}
+
+int IMP_IVS_CreateGroup(int GrpNum) { return 0; }
+int IMP_IVS_DestroyGroup(int GrpNum) { return 0; }
+
+int IMP_IVS_CreateChn(int ChnNum, IMPIVSInterface *handler)
+{
+    if (ChnNum < 0 || ChnNum >= MOCK_IVS_CHANNELS || !handler)
+        return -1;
+    move_params[ChnNum] = *(IMP_IVS_MoveParam *)handler->param;
+    return 0;
+}
+
+int IMP_IVS_DestroyChn(int ChnNum) { return 0; }
+int IMP_IVS_RegisterChn(int GrpNum, int ChnNum) { return 0; }
+int IMP_IVS_UnRegisterChn(int ChnNum) { return 0; }
+int IMP_IVS_StartRecvPic(int ChnNum) { return 0; }
+int IMP_IVS_StopRecvPic(int ChnNum) { return 0; }
+
+int IMP_IVS_PollingResult(int ChnNum, int timeout)
+{
+    if (ChnNum < 0 || ChnNum >= MOCK_IVS_CHANNELS)
+        return -1;
+
+    // a result per analysed frame
+    int skip = move_params[ChnNum].skipFrameCnt + 1;
+    int64_t frame = 1000000LL * (skip > 0 ? skip : 1) / (mock_sensor_fps() ? mock_sensor_fps() : 25);
+    if (timeout < 0)
+    {
+        usleep(frame);
+        return 0;
+    }
+    return mock_poll(mock_now() + frame, timeout) ? 0 : -1;
+}
+
+int IMP_IVS_GetResult(int ChnNum, void **result)
+{
+    if (ChnNum < 0 || ChnNum >= MOCK_IVS_CHANNELS)
+        return -1;
+
+    static int period = mock_env_int("MOCK_IMP_MOTION", 0);
+    bool motion = period > 0 && (mock_now() / 1000000) % period == 0;
+
+    IMP_IVS_MoveOutput &out = move_output[ChnNum];
+    memset(&out, 0, sizeof(out));
+    for (int i = 0; i < move_params[ChnNum].roiRectCnt && i < IMP_IVS_MOVE_MAX_ROI_CNT; i++)
+        out.retRoi[i] = motion;
+    *result = &out;
+    return 0;
+}
+
+int IMP_IVS_ReleaseResult(int ChnNum, void *result) { return 0; }
@@ -0,0 +1,300 @@
+#include "Mock.hpp"
+#include <imp/imp_isp.h>
+#include <imp/imp_system.h>
+#include <imp/imp_framesource.h>
+#include <sysutils/su_base.h>
+#include <atomic>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_32BIT
+#define MAP_32BIT 0
+#endif
+
+#define MOCK_FS_CHANNELS 3
+
+static std::atomic<int64_t> time_offset{0};
+static uint32_t sensor_fps_num = 25;
+static uint32_t sensor_fps_den = 1;
+static IMPISPRunningMode running_mode = IMPISP_RUNNING_MODE_DAY;
+static IMPISPWB white_balance;
+static IMPFSChnAttr fs_attr[MOCK_FS_CHANNELS];
+static IMPFSChnFifoAttr fs_fifo[MOCK_FS_CHANNELS];
+
+const char *mock_env(const char *name)
+{
+    const char *value = getenv(name);
+    return value && *value ? value : nullptr;
+}
+
+int mock_env_int(const char *name, int def)
+{
+    const char *value = mock_env(name);
+    return value ? atoi(value) : def;
+}
+
+bool mock_verbose()
+{
+    static bool verbose = mock_env_int("MOCK_IMP_VERBOSE", 0) != 0;
+    return verbose;
+}
+
+int64_t mock_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+int64_t mock_timestamp(int64_t monotonic_us)
+{
+    return monotonic_us - time_offset.load(std::memory_order_relaxed);
+}
+
+std::vector<uint8_t> mock_read_file(const char *name)
+{
+    const char *path = mock_env(name);
+    if (!path)
+        return {};
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        MOCK_LOG("%s: can't open %s", name, path);
+        return {};
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    MOCK_LOG("%s: %s, %zu bytes", name, path, data.size());
+    return data;
+}
+
+bool mock_poll(int64_t due, uint32_t timeout_ms)
+{
+    static int timeouts = mock_env_int("MOCK_IMP_TIMEOUTS", 0);
+    static thread_local std::minstd_rand rng(std::random_device{}());
+
+    int64_t wait = due - mock_now();
+    if (due == INT64_MAX || wait > timeout_ms * 1000LL ||
+        (timeouts > 0 && (int)(rng() % 100) < timeouts))
+    {
+        usleep(timeout_ms * 1000);
+        return false;
+    }
+    if (wait > 0)
+        usleep(wait);
+    return true;
+}
+
+void *mock_alloc32(size_t size)
+{
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (ptr == MAP_FAILED)
+        return nullptr;
+    if ((uintptr_t)ptr + size > UINT32_MAX)
+    {
+        MOCK_LOG("no memory below 4 GiB for %zu bytes", size);
+        munmap(ptr, size);
+        return nullptr;
+    }
+    return ptr;
+}
+
+void mock_free32(void *ptr, size_t size)
+{
+    if (ptr)
+        munmap(ptr, size);
+}
+
+uint32_t mock_sensor_fps()
+{
+    return sensor_fps_den ? sensor_fps_num / sensor_fps_den : 25;
+}
+
+/* system */
+
+int IMP_System_Init(void)
+{
+    MOCK_LOG("IMP_System_Init, mock SDK for T31 1.1.6");
+    return 0;
+}
+
+int IMP_System_Exit(void)
+{
+    mock_osd_summary();
+    MOCK_DEBUG("IMP_System_Exit");
+    return 0;
+}
+
+int64_t IMP_System_GetTimeStamp(void)
+{
+    return mock_timestamp(mock_now());
+}
+
+int IMP_System_RebaseTimeStamp(int64_t basets)
+{
+    time_offset.store(mock_now() - basets, std::memory_order_relaxed);
+    return 0;
+}
+
+int IMP_System_GetVersion(IMPVersion *pstVersion)
+{
+    snprintf(pstVersion->aVersion, sizeof(pstVersion->aVersion), "IMP-1.1.6-mock");
+    return 0;
+}
+
+const char *IMP_System_GetCPUInfo(void)
+{
+    return "T31-MOCK";
+}
+
+int IMP_System_Bind(IMPCell *srcCell, IMPCell *dstCell)
+{
+    MOCK_DEBUG("IMP_System_Bind(%d.%d.%d, %d.%d.%d)", srcCell->deviceID, srcCell->groupID, srcCell->outputID,
+               dstCell->deviceID, dstCell->groupID, dstCell->outputID);
+    return 0;
+}
+
+int IMP_System_UnBind(IMPCell *srcCell, IMPCell *dstCell)
+{
+    MOCK_DEBUG("IMP_System_UnBind(%d.%d.%d, %d.%d.%d)", srcCell->deviceID, srcCell->groupID, srcCell->outputID,
+               dstCell->deviceID, dstCell->groupID, dstCell->outputID);
+    return 0;
+}
+
+int SU_Base_GetVersion(SUVersion *version)
+{
+    snprintf(version->chr, sizeof(version->chr), "SU-1.1.6-mock");
+    return 0;
+}
+
+/* isp, there is no image to tune */
+
+int IMP_ISP_Open(void) { return 0; }
+int IMP_ISP_Close(void) { return 0; }
+
+int IMP_ISP_AddSensor(IMPSensorInfo *pstSensorInfo)
+{
+    MOCK_LOG("sensor %s", pstSensorInfo->name);
+    return 0;
+}
+
+int IMP_ISP_DelSensor(IMPSensorInfo *pstSensorInfo) { return 0; }
+int IMP_ISP_EnableSensor(void) { return 0; }
+int IMP_ISP_DisableSensor(void) { return 0; }
+int IMP_ISP_EnableTuning(void) { return 0; }
+int IMP_ISP_DisableTuning(void) { return 0; }
+
+int IMP_ISP_Tuning_SetSensorFPS(uint32_t fps_num, uint32_t fps_den)
+{
+    sensor_fps_num = fps_num;
+    sensor_fps_den = fps_den;
+    return 0;
+}
+
+int IMP_ISP_Tuning_GetSensorFPS(uint32_t *fps_num, uint32_t *fps_den)
+{
+    *fps_num = sensor_fps_num;
+    *fps_den = sensor_fps_den;
+    return 0;
+}
+
+int IMP_ISP_Tuning_SetISPRunningMode(IMPISPRunningMode mode)
+{
+    MOCK_DEBUG("running mode %d", mode);
+    running_mode = mode;
+    return 0;
+}
+
+int IMP_ISP_Tuning_GetISPRunningMode(IMPISPRunningMode *pmode)
+{
+    *pmode = running_mode;
+    return 0;
+}
+
+int IMP_ISP_Tuning_SetWB(IMPISPWB *wb)
+{
+    white_balance = *wb;
+    return 0;
+}
+
+int IMP_ISP_Tuning_GetWB(IMPISPWB *wb)
+{
+    *wb = white_balance;
+    return 0;
+}
+
+int IMP_ISP_Tuning_SetBrightness(unsigned char bright) { return 0; }
+int IMP_ISP_Tuning_SetContrast(unsigned char contrast) { return 0; }
+int IMP_ISP_Tuning_SetSharpness(unsigned char sharpness) { return 0; }
+int IMP_ISP_Tuning_SetSaturation(unsigned char sat) { return 0; }
+int IMP_ISP_Tuning_SetBcshHue(unsigned char hue) { return 0; }
+int IMP_ISP_Tuning_SetAeComp(int comp) { return 0; }
+int IMP_ISP_Tuning_SetMaxAgain(uint32_t gain) { return 0; }
+int IMP_ISP_Tuning_SetMaxDgain(uint32_t gain) { return 0; }
+int IMP_ISP_Tuning_SetHiLightDepress(uint32_t strength) { return 0; }
+int IMP_ISP_Tuning_SetBacklightComp(uint32_t strength) { return 0; }
+int IMP_ISP_Tuning_SetTemperStrength(uint32_t ratio) { return 0; }
+int IMP_ISP_Tuning_SetSinterStrength(uint32_t ratio) { return 0; }
+int IMP_ISP_Tuning_SetDPC_Strength(uint32_t ratio) { return 0; }
+int IMP_ISP_Tuning_SetDRC_Strength(uint32_t ratio) { return 0; }
+int IMP_ISP_Tuning_SetDefog_Strength(uint8_t *ratio) { return 0; }
+int IMP_ISP_Tuning_SetAntiFlickerAttr(IMPISPAntiflickerAttr attr) { return 0; }
+int IMP_ISP_Tuning_SetISPBypass(IMPISPTuningOpsMode enable) { return 0; }
+int IMP_ISP_Tuning_SetISPHflip(IMPISPTuningOpsMode mode) { return 0; }
+int IMP_ISP_Tuning_SetISPVflip(IMPISPTuningOpsMode mode) { return 0; }
+
+/* framesource, the encoders produce the frames themselves */
+
+int IMP_FrameSource_CreateChn(int chnNum, IMPFSChnAttr *chn_attr)
+{
+    if (chnNum < 0 || chnNum >= MOCK_FS_CHANNELS)
+        return -1;
+    fs_attr[chnNum] = *chn_attr;
+    MOCK_DEBUG("IMP_FrameSource_CreateChn(%d) %dx%d", chnNum, chn_attr->picWidth, chn_attr->picHeight);
+    return 0;
+}
+
+int IMP_FrameSource_DestroyChn(int chnNum) { return 0; }
+int IMP_FrameSource_EnableChn(int chnNum) { return 0; }
+int IMP_FrameSource_DisableChn(int chnNum) { return 0; }
+
+int IMP_FrameSource_SetChnAttr(int chnNum, const IMPFSChnAttr *chnAttr)
+{
+    if (chnNum < 0 || chnNum >= MOCK_FS_CHANNELS)
+        return -1;
+    fs_attr[chnNum] = *chnAttr;
+    return 0;
+}
+
+int IMP_FrameSource_GetChnAttr(int chnNum, IMPFSChnAttr *chnAttr)
+{
+    if (chnNum < 0 || chnNum >= MOCK_FS_CHANNELS)
+        return -1;
+    *chnAttr = fs_attr[chnNum];
+    return 0;
+}
+
+int IMP_FrameSource_SetChnFifoAttr(int chnNum, IMPFSChnFifoAttr *attr)
+{
+    if (chnNum < 0 || chnNum >= MOCK_FS_CHANNELS)
+        return -1;
+    fs_fifo[chnNum] = *attr;
+    return 0;
+}
+
+int IMP_FrameSource_GetChnFifoAttr(int chnNum, IMPFSChnFifoAttr *attr)
+{
+    if (chnNum < 0 || chnNum >= MOCK_FS_CHANNELS)
+        return -1;
+    *attr = fs_fifo[chnNum];
+    return 0;
+}
+
+int IMP_FrameSource_SetFrameDepth(int chnNum, int depth) { return 0; }
+int IMP_FrameSource_SetChnRotate(int chnNum, uint8_t rotTo90, int width, int height) { return 0; }
@@ -1,7 +1,11 @@
 #include "worker.hpp"
 #include "Motion.hpp"
 #include "AudioReframer.hpp"
+#include "Tracer.hpp"
 #include <cmath>
+#include <algorithm>
+#include <poll.h>
+#include <sys/timerfd.h>
 
 #define MODULE "WORKER"
 
@@ -23,56 +27,113 @@ unsigned long long tDiffInMs(struct timeval *startTime)
     return milliseconds;
 }
 
-static int save_jpeg_stream(int fd, IMPEncoderStream *stream)
+/* Copies the packs of a JPEG stream to dst and returns the image size.
+ * With dst == nullptr only the size is calculated.
+ */
+static size_t copy_jpeg_stream(IMPEncoderStream *stream, uint8_t *dst)
 {
-    int ret, i, nr_pack = stream->packCount;
+    size_t size = 0;
 
-    for (i = 0; i < nr_pack; i++)
+    for (int i = 0; i < (int)stream->packCount; i++)
     {
-        void *data_ptr;
-        size_t data_len;
-
 #if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
         IMPEncoderPack *pack = &stream->pack[i];
-        uint32_t remSize = 0; // Declare remSize here
-        if (pack->length)
-        {
-            remSize = stream->streamSize - pack->offset;
-            data_ptr = (void *)((char *)stream->virAddr + ((remSize < pack->length) ? 0 : pack->offset));
-            data_len = (remSize < pack->length) ? remSize : pack->length;
-        }
-        else
-        {
+        if (!pack->length)
             continue; // Skip empty packs
+
+        uint32_t remSize = stream->streamSize - pack->offset;
+        size_t len = (remSize < pack->length) ? remSize : pack->length;
+        if (dst)
+            memcpy(dst + size, (uint8_t *)stream->virAddr + pack->offset, len);
+        size += len;
+
+        // the pack wraps around the end of the stream buffer
+        if (remSize < pack->length)
+        {
+            if (dst)
+                memcpy(dst + size, (uint8_t *)stream->virAddr, pack->length - remSize);
+            size += pack->length - remSize;
         }
 #elif defined(PLATFORM_T10) || defined(PLATFORM_T20) || defined(PLATFORM_T21) || defined(PLATFORM_T23) || defined(PLATFORM_T30)
-        data_ptr = reinterpret_cast<void *>(stream->pack[i].virAddr);
-        data_len = stream->pack[i].length;
+        if (dst)
+            memcpy(dst + size, reinterpret_cast<void *>(stream->pack[i].virAddr), stream->pack[i].length);
+        size += stream->pack[i].length;
 #endif
+    }
 
-        // Write data to file
-        ret = write(fd, data_ptr, data_len);
-        if (ret != static_cast<int>(data_len))
-        {
-            printf("Stream write error: %s\n", strerror(errno));
-            return -1; // Return error on write failure
-        }
+    return size;
+}
 
-#if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
-        // Check the condition only under T31 platform, as remSize is used here
-        if (remSize && pack->length > remSize)
+// write the snapshot to a temporary file and atomically move it to path
+static void save_jpeg_file(const char *path, const Snapshot::Image &img)
+{
+    std::string tempPath = std::string(path) + ".tmp";
+
+    int snap_fd = open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (snap_fd < 0)
+    {
+        LOG_ERROR("Failed to open JPEG snapshot for writing: " << tempPath);
+        return;
+    }
+
+    ssize_t ret = write(snap_fd, img.data(), img.size());
+    close(snap_fd);
+    if (ret != static_cast<ssize_t>(img.size()))
+    {
+        LOG_ERROR("Stream write error: " << strerror(errno));
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+    if (rename(tempPath.c_str(), path) != 0)
+    {
+        LOG_ERROR("Failed to move JPEG snapshot from " << tempPath << " to " << path);
+        std::remove(tempPath.c_str()); // Attempt to remove the temporary file if rename fails
+    }
+}
+
+/* Sleep until deadline or until wake_fd is signaled. Falls back to
+ * clock_nanosleep() if there is no timerfd.
+ */
+static void jpeg_wait_until(int timer_fd, int wake_fd, steady_clock::time_point deadline)
+{
+    auto ns = duration_cast<nanoseconds>(deadline.time_since_epoch()).count();
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+
+    // steady_clock is CLOCK_MONOTONIC
+    if (timer_fd < 0)
+    {
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        return;
+    }
+
+    struct itimerspec its{};
+    its.it_value = ts;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+
+    struct pollfd fds[2] = {{timer_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+    if (poll(fds, 2, -1) > 0)
+    {
+        uint64_t expirations;
+        for (auto &fd : fds)
         {
-            ret = write(fd, (void *)((char *)stream->virAddr), pack->length - remSize);
-            if (ret != static_cast<int>(pack->length - remSize))
-            {
-                printf("Stream write error (remaining part): %s\n", strerror(errno));
-                return -1;
-            }
+            if ((fd.revents & POLLIN) && read(fd.fd, &expirations, sizeof(expirations)) < 0)
+                LOG_DDEBUG("jpeg wakeup read failed: " << strerror(errno));
         }
-#endif
     }
+}
 
-    return 0;
+// true if an active jpeg channel encodes from video channel encChn
+static bool jpeg_uses_channel(int encChn)
+{
+    for (auto &jpeg : global_jpeg)
+    {
+        if (jpeg && jpeg->active && jpeg->streamChn == encChn)
+            return true;
+    }
+    return false;
 }
 
 void *Worker::jpeg_grabber(void *arg)
@@ -97,22 +158,16 @@ void *Worker::jpeg_grabber(void *arg)
  
     // timestamp for stream stats calculation
     unsigned long long ms{0};
+    steady_clock::time_point last_save{};
     gettimeofday(&global_jpeg[jpgChn]->stream->stats.ts, NULL);
     global_jpeg[jpgChn]->stream->stats.ts.tv_sec -= 10;
 
-    if (global_jpeg[jpgChn]->streamChn == 0)
-    {
-        cfg->stream2.width = cfg->stream0.width;
-        cfg->stream2.height = cfg->stream0.height;
-    } 
-    else
-    {
-        cfg->stream2.width = cfg->stream1.width;
-        cfg->stream2.height = cfg->stream1.height;        
-    }
+    _stream *source = global_video[global_jpeg[jpgChn]->streamChn]->stream;
+    global_jpeg[jpgChn]->stream->width = source->width;
+    global_jpeg[jpgChn]->stream->height = source->height;
 
     global_jpeg[jpgChn]->imp_encoder = IMPEncoder::createNew(
-        global_jpeg[jpgChn]->stream, sh->encChn, global_jpeg[jpgChn]->streamChn, "stream2");
+        global_jpeg[jpgChn]->stream, sh->encChn, global_jpeg[jpgChn]->streamChn, global_jpeg[jpgChn]->name);
 
     // inform main that initialization is complete
     sh->has_started.release();
@@ -122,6 +177,10 @@ void *Worker::jpeg_grabber(void *arg)
     if (ret != 0)
         return 0;
 
+    // wakes the thread at the next frame deadline
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    LOG_DEBUG_OR_ERROR(timer_fd < 0, "timerfd_create()");
+
     global_jpeg[jpgChn]->active = true;
     global_jpeg[jpgChn]->running = true;
     while (global_jpeg[jpgChn]->running)
@@ -132,111 +191,100 @@ void *Worker::jpeg_grabber(void *arg)
         * if a client is connected via WS / HTTP we try to reach a framerate of stream.fps
         * the thread will fallback into idle / sleep mode if no client request was made for more than a second
         */
-        auto now = steady_clock::now();
-        
-        std::unique_lock lck(mutex_main);
         bool request_or_overrun = global_jpeg[jpgChn]->request_or_overrun();
-        lck.unlock();
 
-        if (request_or_overrun || targetFps)
+        // subscriber is connected
+        if (request_or_overrun)
         {
-            auto diff_last_image = duration_cast<milliseconds>(now - global_jpeg[jpgChn]->last_image).count();
+            targetFps = global_jpeg[jpgChn]->stream->fps;
+        }
+        // no subscriber is connected
+        else
+        {
+            targetFps = global_jpeg[jpgChn]->stream->jpeg_idle_fps;
+        }
+
+        if (targetFps)
+        {
+            auto now = steady_clock::now();
 
             // we remove targetFps/10 millisecond's as image creation time
             // by this we get besser FPS results
-            if(targetFps && diff_last_image >= ((1000/targetFps)-targetFps/10))
-            {   
-                // check if current jpeg channal is running if not start it
-                if(!global_video[global_jpeg[jpgChn]->streamChn]->active) {
-                    
-                    /* required video channel was not running, we need to start it  
-                    * and set run_for_jpeg as a reason.
-                    */
-                    std::unique_lock<std::mutex> lock_stream{mutex_main};
-                    global_video[global_jpeg[jpgChn]->streamChn]->run_for_jpeg = true;
-                    global_video[global_jpeg[jpgChn]->streamChn]->should_grab_frames.notify_one();
-                    lock_stream.unlock();
-                    global_video[global_jpeg[jpgChn]->streamChn]->is_activated.acquire();
-                }
+            auto next_image = global_jpeg[jpgChn]->last_image + milliseconds((1000 / targetFps) - targetFps / 10);
+            if (now < next_image)
+            {
+                /* sleep until the image is due, a new subscriber wakes us
+                 * up earlier through wake_fd to switch from idle fps to fps
+                 */
+                jpeg_wait_until(timer_fd, global_jpeg[jpgChn]->wake_fd, next_image);
+                continue;
+            }
 
-                // subscriber is connected
-                if(request_or_overrun) 
-                {
-                    if(targetFps != global_jpeg[jpgChn]->stream->fps)
-                        targetFps = global_jpeg[jpgChn]->stream->fps;
-                }
-                // no subscriber is connected
-                else
-                {
-                    if(targetFps != global_jpeg[jpgChn]->stream->jpeg_idle_fps)
-                        targetFps = global_jpeg[jpgChn]->stream->jpeg_idle_fps;
-                }
+            // check if current jpeg channal is running if not start it
+            if(!global_video[global_jpeg[jpgChn]->streamChn]->active) {
+                
+                /* required video channel was not running, we need to start it  
+                * and set run_for_jpeg as a reason.
+                */
+                video_stream *video = global_video[global_jpeg[jpgChn]->streamChn].get();
+                video->run_for_jpeg = true;
+
+                /* both jpeg channels may wait for the same video channel,
+                 * so wait for its state rather than for a single signal
+                 */
+                std::unique_lock lock_video{video->mtx};
+                video->should_grab_frames.notify_all();
+                video->should_grab_frames.wait_for(lock_video, seconds(1), [video]
+                                                   { return video->active.load(); });
+            }
 
-                if (IMP_Encoder_PollingStream(global_jpeg[jpgChn]->encChn, cfg->general.imp_polling_timeout) == 0)
+            if (IMP_Encoder_PollingStream(global_jpeg[jpgChn]->encChn, cfg->general.imp_polling_timeout) == 0)
+            {
+                IMPEncoderStream stream;
+                if (IMP_Encoder_GetStream(global_jpeg[jpgChn]->encChn, &stream, GET_STREAM_BLOCKING) == 0)
                 {
-                    IMPEncoderStream stream;
-                    if (IMP_Encoder_GetStream(global_jpeg[jpgChn]->encChn, &stream, GET_STREAM_BLOCKING) == 0)
-                    {
-                        fps++;
-                        bps += stream.pack->length;
-
-                        //  Check for success
-                        const char *tempPath = "/tmp/snapshot.tmp";             // Temporary path
-                        const char *finalPath = global_jpeg[jpgChn]->stream->jpeg_path; // Final path for the JPEG snapshot
-
-                        // Open and create temporary file with read and write permissions
-                        int snap_fd = open(tempPath, O_RDWR | O_CREAT | O_TRUNC, 0666);
-                        if (snap_fd >= 0)
-                        {
-                            // Save the JPEG stream to the file
-                            save_jpeg_stream(snap_fd, &stream);
+                    fps++;
+                    bps += stream.pack->length;
 
-                            // Close the temporary file after writing is done
-                            close(snap_fd);
+                    int64_t capture_ts = stream.packCount > 0 ? stream.pack[stream.packCount - 1].timestamp : 0;
 
-                            // Atomically move the temporary file to the final destination
-                            if (rename(tempPath, finalPath) != 0)
-                            {
-                                LOG_ERROR("Failed to move JPEG snapshot from " << tempPath << " to " << finalPath);
-                                std::remove(tempPath); // Attempt to remove the temporary file if rename fails
-                            }
-                            else
-                            {
-                                // LOG_DEBUG("JPEG snapshot successfully updated");
-                            }
-                        }
-                        else
-                        {
-                            LOG_ERROR("Failed to open JPEG snapshot for writing: " << tempPath);
-                        }
+                    auto img = global_jpeg[jpgChn]->snapshot.prepare(copy_jpeg_stream(&stream, nullptr));
+                    copy_jpeg_stream(&stream, img->data());
+                    IMP_Encoder_ReleaseStream(global_jpeg[jpgChn]->encChn, &stream); // Release stream after copying
 
-                        IMP_Encoder_ReleaseStream(global_jpeg[jpgChn]->encChn, &stream); // Release stream after saving
-                    }
+                    global_jpeg[jpgChn]->snapshot.publish(img);
+                    if (capture_ts > 0)
+                        global_jpeg[jpgChn]->encode_time.observe(metrics_elapsed_us(capture_ts));
 
-                    ms = tDiffInMs(&global_jpeg[jpgChn]->stream->stats.ts);
-                    if (ms > 1000)
+                    // the file on disk is only refreshed every jpeg_save_interval ms, -1 disables it
+                    int saveInterval = global_jpeg[jpgChn]->stream->jpeg_save_interval;
+                    if (saveInterval >= 0 &&
+                        duration_cast<milliseconds>(now - last_save).count() >= saveInterval)
                     {
-                        global_jpeg[jpgChn]->stream->stats.fps = fps;
-                        global_jpeg[jpgChn]->stream->stats.bps = bps;
-                        fps = 0; bps = 0;
-                        gettimeofday(&global_jpeg[jpgChn]->stream->stats.ts, NULL);
-
-                        LOG_DDEBUG("JPG " << jpgChn << 
-                                " fps: " << global_jpeg[jpgChn]->stream->stats.fps << 
-                                " bps: " << global_jpeg[jpgChn]->stream->stats.bps <<
-                                " diff_last_image: " << diff_last_image <<
-                                " request_or_overrun: " << request_or_overrun <<
-                                " targetFps: " << targetFps <<
-                                " ms: " << ms);
-                    }                
+                        save_jpeg_file(global_jpeg[jpgChn]->stream->jpeg_path, *img);
+                        last_save = now;
+                    }
                 }
 
-                global_jpeg[jpgChn]->last_image = steady_clock::now();
-            }
-            else
-            {
-                usleep(1000);
+                ms = tDiffInMs(&global_jpeg[jpgChn]->stream->stats.ts);
+                if (ms > 1000)
+                {
+                    global_jpeg[jpgChn]->stream->stats.fps = fps;
+                    global_jpeg[jpgChn]->stream->stats.bps = bps;
+                    fps = 0; bps = 0;
+                    gettimeofday(&global_jpeg[jpgChn]->stream->stats.ts, NULL);
+
+                    LOG_DDEBUG("JPG " << jpgChn << 
+                            " fps: " << global_jpeg[jpgChn]->stream->stats.fps << 
+                            " bps: " << global_jpeg[jpgChn]->stream->stats.bps <<
+                            " diff_last_image: " << duration_cast<milliseconds>(now - global_jpeg[jpgChn]->last_image).count() <<
+                            " request_or_overrun: " << request_or_overrun <<
+                            " targetFps: " << targetFps <<
+                            " ms: " << ms);
+                }                
             }
+
+            global_jpeg[jpgChn]->last_image = steady_clock::now();
         }
         else
         {
@@ -245,16 +293,17 @@ void *Worker::jpeg_grabber(void *arg)
 
             global_jpeg[jpgChn]->stream->stats.bps = 0;
             global_jpeg[jpgChn]->stream->stats.fps = 0;
-            targetFps = 0;
 
-            std::unique_lock<std::mutex> lock_stream{mutex_main};
+            /* 'active' is cleared before the subscriber timestamp is checked,
+             * jpeg_stream::request() stores the timestamp before it checks
+             * 'active', so either we see the request or it wakes us up.
+             */
+            std::unique_lock lock_stream{global_jpeg[jpgChn]->mtx};
             global_jpeg[jpgChn]->active = false;
-            global_video[global_jpeg[jpgChn]->streamChn]->run_for_jpeg = false;
-            while (!global_jpeg[jpgChn]->request_or_overrun() && !global_restart_video)
+            global_video[global_jpeg[jpgChn]->streamChn]->run_for_jpeg = jpeg_uses_channel(global_jpeg[jpgChn]->streamChn);
+            while (!global_jpeg[jpgChn]->request_or_overrun() && !global_restart_video && global_jpeg[jpgChn]->running)
                 global_jpeg[jpgChn]->should_grab_frames.wait(lock_stream);
 
-            targetFps = global_jpeg[jpgChn]->stream->fps;
-
             global_jpeg[jpgChn]->is_activated.release();
             global_jpeg[jpgChn]->active = true;
 
@@ -263,6 +312,9 @@ void *Worker::jpeg_grabber(void *arg)
         }
     }
 
+    if (timer_fd >= 0)
+        close(timer_fd);
+
     if (global_jpeg[jpgChn]->imp_encoder)
     {
         global_jpeg[jpgChn]->imp_encoder->deinit();
@@ -276,6 +328,102 @@ void *Worker::jpeg_grabber(void *arg)
     return 0;
 }
 
+/* Encoder streams are handed back in the order they were taken. The
+ * head of held_streams is released as soon as it is no longer pinned,
+ * along with the unpinned streams queued behind it.
+ */
+static void release_held_streams(int encChn, video_stream *video)
+{
+    while (!video->held_streams.empty() && !video->held_streams.front().pinned)
+    {
+        IMP_Encoder_ReleaseStream(encChn, &video->held_streams.front().stream);
+        video->held_streams.pop_front();
+    }
+}
+
+/* Keep an encoder stream alive as long as NAL units point into it.
+ * The last reference releases it, once the streams before it are released.
+ */
+static std::shared_ptr<const IMPEncoderStream> pin_stream(int encChn, const IMPEncoderStream &stream)
+{
+    video_stream *video = global_video[encChn].get();
+    std::lock_guard lock{video->held_mtx};
+    // deque references stay valid while other elements are added and removed
+    video_stream::held_stream &held = video->held_streams.emplace_back(video_stream::held_stream{stream, true});
+    video->pinned_streams++;
+    return std::shared_ptr<const IMPEncoderStream>(&held.stream,
+        [encChn, video, &held](const IMPEncoderStream *)
+        {
+            std::lock_guard lock{video->held_mtx};
+            held.pinned = false;
+            release_held_streams(encChn, video);
+            video->pinned_streams--;
+            video->held_cv.notify_all();
+        });
+}
+
+/* True if the next stream may be pinned. At the limit, a reader lags
+ * behind: the NAL units still queued from the pinned streams are copied
+ * out, so those streams go back to the encoder right away instead of
+ * holding up the following ones until the reader catches up.
+ */
+static bool can_pin(int encChn)
+{
+    video_stream *video = global_video[encChn].get();
+    std::vector<const void *> pinned;
+    {
+        std::lock_guard lock{video->held_mtx};
+        if (video->held_streams.size() < MAX_PINNED_STREAMS)
+            return true;
+        for (auto &held : video->held_streams)
+        {
+            if (held.pinned)
+                pinned.push_back(&held.stream);
+        }
+    }
+
+    // only this thread pins streams, the addresses stay unique meanwhile
+    video->msgChannel->detach(
+        [&pinned](const H264NALUnit &nalu)
+        { return std::find(pinned.begin(), pinned.end(), nalu.data.owner_ptr()) != pinned.end(); },
+        [](H264NALUnit &nalu)
+        { nalu.data = nalu.data.clone(); });
+
+    std::lock_guard lock{video->held_mtx};
+    return video->held_streams.size() < MAX_PINNED_STREAMS;
+}
+
+// Hand back a stream whose packs were copied, after the pinned ones before it
+static void release_stream(int encChn, IMPEncoderStream &stream)
+{
+    video_stream *video = global_video[encChn].get();
+    std::lock_guard lock{video->held_mtx};
+    if (video->held_streams.empty())
+        IMP_Encoder_ReleaseStream(encChn, &stream);
+    else
+        video->held_streams.push_back(video_stream::held_stream{stream, false});
+}
+
+/* Drop all queued NAL units and wait until every encoder stream
+ * pinned by them has been handed back to the encoder. The caller must
+ * not hold the stream mutex, the sources take it to unsubscribe.
+ * Sources copy the NAL unit they hold back, so the remaining references
+ * are on their way to the sink. The encoder must not be stopped with
+ * streams outstanding, so this doesn't give up.
+ */
+static void release_pinned_streams(int encChn)
+{
+    video_stream *video = global_video[encChn].get();
+    video->msgChannel->clear();
+
+    std::unique_lock lock{video->held_mtx};
+    while (!video->held_cv.wait_for(lock, seconds(1), [video]
+                                    { return video->held_streams.empty(); }))
+    {
+        LOG_ERROR("stream " << encChn << " still has " << video->pinned_streams << " pinned encoder streams");
+    }
+}
+
 void *Worker::stream_grabber(void *arg)
 {
     StartHelper *sh = static_cast<StartHelper *>(arg);
@@ -289,11 +437,16 @@ void *Worker::stream_grabber(void *arg)
     uint32_t error_count = 0;
     unsigned long long ms = 0;
     bool run_for_jpeg = false;
+    bool is_h265 = strcmp(global_video[encChn]->stream->format, "H265") == 0;
+    FrameArena gop_arena(cfg->rtsp.gop_cache_size); // GOP cache, replayed to new clients
 
     global_video[encChn]->imp_framesource = IMPFramesource::createNew(global_video[encChn]->stream, &cfg->sensor, encChn);
     global_video[encChn]->imp_encoder = IMPEncoder::createNew(global_video[encChn]->stream, encChn, encChn, global_video[encChn]->name);
     global_video[encChn]->imp_framesource->enable();
     global_video[encChn]->run_for_jpeg = false;
+    global_video[encChn]->source_fps = global_video[encChn]->imp_encoder->sourceFps;
+    global_video[encChn]->bitrate = global_video[encChn]->imp_encoder->currentBitrate();
+    global_video[encChn]->reconfigure = false;
 
     // inform main that initialization is complete
     sh->has_started.release();
@@ -311,10 +464,17 @@ void *Worker::stream_grabber(void *arg)
     global_video[encChn]->running = true;
     while (global_video[encChn]->running)
     {
-        /* bool helper to check if this is the active jpeg channel and a jpeg is requested while 
+        // parameters changed via WS which the encoder takes without restart
+        if (global_video[encChn]->reconfigure.exchange(false))
+        {
+            global_video[encChn]->imp_encoder->reconfigure();
+            global_video[encChn]->bitrate = global_video[encChn]->imp_encoder->currentBitrate();
+        }
+
+        /* bool helper to check if an active jpeg channel uses this channel and a jpeg is requested while 
          * the channel is inactive
          */
-        run_for_jpeg = (encChn == global_jpeg[0]->streamChn && global_video[encChn]->run_for_jpeg);
+        run_for_jpeg = (global_video[encChn]->run_for_jpeg && jpeg_uses_channel(encChn));
 
         /* now we need to verify that 
          * 1. a client is connected (hasDataCallback)
@@ -329,9 +489,24 @@ void *Worker::stream_grabber(void *arg)
                 {
                     LOG_ERROR("IMP_Encoder_GetStream(" << encChn << ") failed");
                     error_count++;
+                    global_video[encChn]->stats.getstream_errors.add();
                     continue;
                 }
 
+                // encoder timestamps are CLOCK_MONOTONIC based, see IMPSystem
+                int64_t au_ts = stream.packCount > 0 ? stream.pack[stream.packCount - 1].timestamp : 0;
+                if (au_ts > 0)
+                    global_video[encChn]->stats.latency.observe(metrics_elapsed_us(au_ts));
+                Tracer::instance().stamp(Tracer::GET_STREAM, encChn, 0, au_ts);
+
+                /* NAL units reference the encoder memory directly, the stream
+                 * is released when the last of them has been delivered.
+                 * If the consumer lags behind, copy to keep the encoder going.
+                 */
+                std::shared_ptr<const IMPEncoderStream> pin;
+                if (global_video[encChn]->hasDataCallback && !gop_arena.valid() && can_pin(encChn))
+                    pin = pin_stream(encChn, stream);
+
                 /* timestamp fix, can be removed if solved
                 int64_t nal_ts = stream.pack[stream.packCount - 1].timestamp;
                 struct timeval encoder_time;
@@ -349,9 +524,12 @@ void *Worker::stream_grabber(void *arg)
 #if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
                         uint8_t *start = (uint8_t *)stream.virAddr + stream.pack[i].offset;
                         uint8_t *end = start + stream.pack[i].length;
+                        uint32_t remSize = stream.streamSize - stream.pack[i].offset;
+                        bool wrapped = remSize < stream.pack[i].length;
 #elif defined(PLATFORM_T10) || defined(PLATFORM_T20) || defined(PLATFORM_T21) || defined(PLATFORM_T23) || defined(PLATFORM_T30)
                         uint8_t *start = (uint8_t *)stream.pack[i].virAddr;
                         uint8_t *end = (uint8_t *)stream.pack[i].virAddr + stream.pack[i].length;
+                        bool wrapped = false;
 #endif
                         H264NALUnit nalu;
 
@@ -397,7 +575,24 @@ void *Worker::stream_grabber(void *arg)
 
                         // We use start+4 because the encoder inserts 4-byte MPEG
                         //'startcodes' at the beginning of each NAL. Live555 complains
-                        nalu.data.insert(nalu.data.end(), start + 4, end);
+                        if (wrapped)
+                        {
+#if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
+                            // the pack wraps around the end of the stream buffer
+                            size_t skip = std::min<size_t>(remSize, 4);
+                            nalu.data = FrameData::copy(start + skip, remSize - skip,
+                                                        (uint8_t *)stream.virAddr + 4 - skip,
+                                                        stream.pack[i].length - remSize - (4 - skip));
+#endif
+                        }
+                        else if (pin)
+                        {
+                            nalu.data = FrameData(pin, start + 4, end - start - 4);
+                        }
+                        else
+                        {
+                            nalu.data = FrameData::copy(start + 4, end - start - 4);
+                        }
                         if (global_video[encChn]->idr == false)
                         {
 #if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
@@ -434,20 +629,30 @@ void *Worker::stream_grabber(void *arg)
 
                         if (global_video[encChn]->idr == true)
                         {
-                            if (!global_video[encChn]->msgChannel->write(nalu))
+                            /* readers joining or falling behind resume at a NAL unit
+                             * carrying parameter sets, which starts every keyframe
+                             */
+                            bool key = !nalu.data.empty() && (is_h265 ? ((nalu.data[0] & 0x7E) >> 1) == 32 : (nalu.data[0] & 0x1F) == 7);
+
+                            /* while the GOP fits into the arena, the arena copy replaces
+                             * the encoder memory and is kept for new readers
+                             */
+                            if (key)
+                                gop_arena.reset();
+                            FrameData cached = gop_arena.store(nalu.data.data(), nalu.data.size());
+                            if (!cached.empty())
+                                nalu.data = std::move(cached);
+
+                            // the channel notifies its readers, a lagging reader is logged by its source
+                            if (!global_video[encChn]->msgChannel->write(std::move(nalu), key, gop_arena.valid()))
                             {
-                                LOG_ERROR("video " << 
+                                global_video[encChn]->stats.channel_overruns.add();
+                                LOG_DDEBUG("video " << 
                                     "channel:" << encChn << ", " <<
                                     "package:" << i << " of " << stream.packCount << ", " <<
-                                    "packageSize:" << nalu.data.size() <<
+                                    "packageSize:" << stream.pack[i].length <<
                                     ".  !sink clogged!");
                             }
-                            else
-                            {
-                                std::unique_lock<std::mutex> lock_stream{global_video[encChn]->onDataCallbackLock};
-                                if (global_video[encChn]->onDataCallback)
-                                    global_video[encChn]->onDataCallback();
-                            }
                         }
 #if defined(USE_AUDIO_STREAM_REPLICATOR)
                         /* Since the audio stream is permanently in use by the stream replicator, 
@@ -460,13 +665,19 @@ void *Worker::stream_grabber(void *arg)
                                 !global_audio[0]->active << " " << 
                                 cfg->audio.input_enabled
                             );                            
-                            global_audio[0]->should_grab_frames.notify_one();
+                            global_audio[0]->wake();
                         }
 #endif
                     }
                 }
 
-                IMP_Encoder_ReleaseStream(encChn, &stream);
+                if (global_video[encChn]->hasDataCallback)
+                    Tracer::instance().stamp(Tracer::CHANNEL_WRITE, encChn, 0, au_ts);
+
+                if (pin)
+                    pin.reset(); // released by the last queued NAL unit
+                else
+                    release_stream(encChn, stream);
 
                 ms = tDiffInMs(&global_video[encChn]->stream->stats.ts);
                 if (ms > 1000)
@@ -483,17 +694,20 @@ void *Worker::stream_grabber(void *arg)
                     fps = 0; bps = 0;
                     gettimeofday(&global_video[encChn]->stream->stats.ts, NULL);
                     global_video[encChn]->stream->osd.stats.ts = global_video[encChn]->stream->stats.ts;
-                    /*
+
+                    // encoder queue depth, a growing backlog means we don't keep up
                     IMPEncoderCHNStat encChnStats;
-                    IMP_Encoder_Query(channel->encChn, &encChnStats);
-                    LOG_DEBUG("ChannelStats::" << channel->encChn <<
-                                ", registered:" << encChnStats.registered <<
-                                ", leftPics:" << encChnStats.leftPics <<
-                                ", leftStreamBytes:" << encChnStats.leftStreamBytes <<
-                                ", leftStreamFrames:" << encChnStats.leftStreamFrames <<
-                                ", curPacks:" << encChnStats.curPacks <<
-                                ", work_done:" << encChnStats.work_done);
-                    */
+                    if (IMP_Encoder_Query(encChn, &encChnStats) == 0)
+                    {
+                        global_video[encChn]->stats.left_pics.set(encChnStats.leftPics);
+                        global_video[encChn]->stats.left_stream_bytes.set(encChnStats.leftStreamBytes);
+                        global_video[encChn]->stats.left_stream_frames.set(encChnStats.leftStreamFrames);
+                        LOG_DDEBUG("ChannelStats::" << encChn <<
+                                    ", leftPics:" << encChnStats.leftPics <<
+                                    ", leftStreamBytes:" << encChnStats.leftStreamBytes <<
+                                    ", leftStreamFrames:" << encChnStats.leftStreamFrames <<
+                                    ", curPacks:" << encChnStats.curPacks);
+                    }
                     if (global_video[encChn]->idr_fix)
                     {
                         IMP_Encoder_RequestIDR(encChn);
@@ -504,14 +718,15 @@ void *Worker::stream_grabber(void *arg)
             else
             {
                 error_count++;
+                global_video[encChn]->stats.polling_timeouts.add();
                 LOG_DDEBUG("IMP_Encoder_PollingStream(" << encChn << ", " << cfg->general.imp_polling_timeout << ") timeout !");
             }
         }
-        else if (global_video[encChn]->onDataCallback == nullptr && !global_restart_video && !global_video[encChn]->run_for_jpeg)
+        else if (!global_video[encChn]->hasDataCallback && !global_restart_video && !global_video[encChn]->run_for_jpeg)
         {
             LOG_DDEBUG("VIDEO LOCK" << 
                        " channel:" << encChn << 
-                       " hasCallbackIsNull:" << (global_video[encChn]->onDataCallback == nullptr) << 
+                       " hasCallbackIsNull:" << !global_video[encChn]->hasDataCallback << 
                        " restartVideo:" << global_restart_video << 
                        " runForJpeg:" << global_video[encChn]->run_for_jpeg);
 
@@ -520,22 +735,35 @@ void *Worker::stream_grabber(void *arg)
             global_video[encChn]->stream->osd.stats.bps = 0;
             global_video[encChn]->stream->osd.stats.fps = 0;
 
-            std::unique_lock<std::mutex> lock_stream{mutex_main};           
+            std::unique_lock lock_stream{global_video[encChn]->mtx};
             global_video[encChn]->active = false;
-            while (global_video[encChn]->onDataCallback == nullptr && !global_restart_video && !global_video[encChn]->run_for_jpeg)
+
+            // nobody reads the channel anymore, hand back the pinned streams
+            if (!global_video[encChn]->hasDataCallback)
+            {
+                lock_stream.unlock();
+                release_pinned_streams(encChn);
+                lock_stream.lock();
+            }
+
+            while (!global_video[encChn]->hasDataCallback && !global_restart_video && !global_video[encChn]->run_for_jpeg)
                 global_video[encChn]->should_grab_frames.wait(lock_stream);
 
+            // wake up the jpeg grabbers waiting for the channel
             global_video[encChn]->active = true;
-            global_video[encChn]->is_activated.release();
+            global_video[encChn]->should_grab_frames.notify_all();
             
-            // unlock audio
-            global_audio[0]->should_grab_frames.notify_one();
+            // unlock audio, it waits for a video channel with readers
+            lock_stream.unlock();
+            global_audio[0]->wake();
 
             LOG_DDEBUG("VIDEO UNLOCK" << 
                        " channel:" << encChn);           
         }
     }
 
+    release_pinned_streams(encChn);
+
     ret = IMP_Encoder_StopRecvPic(encChn);
     LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_StopRecvPic(" << encChn << ")");
 
@@ -589,6 +817,7 @@ static void process_audio_frame(int encChn, IMPAudioFrame &frame)
 
     AudioFrame af;
     af.time = normalized_time;
+    af.imp_ts = audio_ts;
 
     uint8_t *start = (uint8_t *)frame.virAddr;
     uint8_t *end = start + frame.len;
@@ -617,7 +846,7 @@ static void process_audio_frame(int encChn, IMPAudioFrame &frame)
 
     if (end > start)
     {
-        af.data.insert(af.data.end(), start, end);
+        af.data = FrameData::copy(start, end - start);
     }
 
     if (!af.data.empty() && global_audio[encChn]->hasDataCallback && (global_video[0]->hasDataCallback || global_video[1]->hasDataCallback))
@@ -632,7 +861,7 @@ static void process_audio_frame(int encChn, IMPAudioFrame &frame)
         }
         else
         {
-            std::unique_lock<std::mutex> lock_stream{global_audio[encChn]->onDataCallbackLock};
+            std::unique_lock lock_stream{global_audio[encChn]->onDataCallbackLock};
             if (global_audio[encChn]->onDataCallback)
                 global_audio[encChn]->onDataCallback();
         }
@@ -761,7 +990,7 @@ void *Worker::audio_grabber(void *arg)
         }
         else if (cfg->audio.input_enabled && !global_restart)
         {
-            std::unique_lock<std::mutex> lock_stream{mutex_main};
+            std::unique_lock lock_stream{global_audio[encChn]->mtx};
             global_audio[encChn]->active = false;
             LOG_DDEBUG("AUDIO LOCK");
 
@@ -816,7 +1045,7 @@ void *Worker::update_osd(void *arg)
                     {
                         if (v->imp_encoder->osd->is_started)
                         {
-                            v->imp_encoder->osd->updateDisplayEverySecond();
+                            v->imp_encoder->osd->update();
                         }
                         else
                         {